@@ -0,0 +1,417 @@
+#include "mediators.cpp"
+#include "schema.cpp"
+#include "transaction.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Generates a brewery at the given scale and measures every mediator operation
+// and stored procedure against it. Results go out as JSON, a summary to stderr:
+//     BreweryBench [--orders N] [--waiters N] [--drinks N] [--ingredients N] [--years N]
+//                  [--seconds S] [--database path] [--reuse] [--output results.json]
+
+using BenchClock = std::chrono::steady_clock;
+
+struct BenchOptions{
+    int Orders = 1000000;
+    int Waiters = 40;
+    int Drinks = 200;
+    int Ingredients = 120;
+    int Goblets = 12;
+    int Years = 4;
+    int LastYear = 2024;
+    // Time given to each operation, at least MinIterations runs are made anyway
+    double Seconds = 1.0;
+    const char *Database = "brewery_bench.sqlite";
+    const char *Output = nullptr;
+    bool Reuse = false;
+};
+
+static constexpr int MinIterations = 5;
+static constexpr int MaxIterations = 200000;
+
+static const char *const FirstNames[] = {
+    "Aldric", "Berta", "Cedric", "Dagny", "Edda", "Falk", "Gunnar", "Hilda", "Ivo", "Jorunn",
+    "Kasimir", "Liesel", "Magnus", "Nele", "Odo", "Petra", "Quirin", "Ragna", "Sigrun", "Tilda"
+};
+
+static const char *const DrinkStyles[] = {
+    "Ale", "Stout", "Porter", "Lager", "Mead", "Cider", "Bock", "Pilsner", "Weizen", "Kvass"
+};
+
+static const char *const DrinkAdjectives[] = {
+    "Golden", "Dark", "Smoked", "Honeyed", "Bitter", "Spiced", "Old", "Royal", "Wild", "Frosty"
+};
+
+static const char *const IngredientKinds[][2] = {
+    {"Malt", "kg"}, {"Hops", "g"}, {"Yeast", "g"}, {"Honey", "kg"}, {"Water", "l"},
+    {"Apples", "kg"}, {"Rye", "kg"}, {"Wheat", "kg"}, {"Juniper", "g"}, {"Cinnamon", "g"}
+};
+
+static const char *const Cities[] = {
+    "Lviv", "Kyiv", "Odesa", "Kharkiv", "Dnipro", "Uzhhorod", "Chernivtsi", "Poltava"
+};
+
+// Relative number of orders in each month, taverns are busiest in summer and December
+static const int MonthWeights[] = {6, 5, 6, 7, 8, 10, 11, 10, 8, 7, 7, 12};
+
+struct Scale{
+    int Waiters = 0;
+    int Drinks = 0;
+    int Ingredients = 0;
+    int Goblets = 0;
+    int Orders = 0;
+    int DrinkOrders = 0;
+    int Recipes = 0;
+};
+
+static Date RandomDate(std::mt19937 &random, const BenchOptions &options){
+    int month = 0;
+    int weight = random() % 97;
+    while(weight >= MonthWeights[month])
+        weight -= MonthWeights[month++];
+
+    Date date;
+    date.Year = options.LastYear - options.Years + 1 + random() % options.Years;
+    date.Month = month + 1;
+    date.Day = 1 + random() % 28;
+    return date;
+}
+
+static Scale Generate(Database &db, const BenchOptions &options){
+    std::mt19937 random(42);
+    Scale scale;
+
+    Transaction transaction(db);
+
+    AddressesTableMediator addresses(db);
+    SourcesTableMediator sources(db);
+    for(int i = 0; i < (int)std::size(Cities) * 3; i++){
+        const int address = addresses.TryAdd(Cities[i % std::size(Cities)], Stmt("%", 1 + i), 79000 + i);
+        sources.Add(Stmt("% Farm %", Cities[i % std::size(Cities)], i), address);
+    }
+    const int sources_count = (int)sources.Size();
+
+    IngredientsTableMediator ingredients(db);
+    for(int i = 0; i < options.Ingredients; i++){
+        const auto &kind = IngredientKinds[i % std::size(IngredientKinds)];
+        const int id = ingredients.Add(Stmt("% #%", kind[0], i), kind[1], 1 + random() % sources_count);
+        db.Execute("UPDATE Ingredients SET PricePerUnit = ? WHERE ID = ?", (random() % 2000) / 100.0, id);
+    }
+    scale.Ingredients = options.Ingredients;
+
+    DrinksTableMediator drinks(db);
+    IngredientsDrinksTableMediator recipes(db);
+    const int first_drink = (int)drinks.ReserveIDs(options.Drinks);
+    for(int i = 0; i < options.Drinks; i++){
+        const char *adjective = DrinkAdjectives[random() % std::size(DrinkAdjectives)];
+        const char *style = DrinkStyles[random() % std::size(DrinkStyles)];
+        drinks.Add(first_drink + i, Stmt("% % %", adjective, style, i + 1), 2.0f + (random() % 800) / 100.0f, random() % 3 ? 18 : 0);
+
+        const int ingredients_count = 3 + random() % 6;
+        for(int j = 0; j < ingredients_count; j++)
+            recipes.Add(1 + random() % options.Ingredients, 0.1f + (random() % 500) / 100.0f, first_drink + i);
+        scale.Recipes += ingredients_count;
+    }
+    scale.Drinks = options.Drinks;
+
+    GobletsTableMediator goblets(db);
+    for(int i = 0; i < options.Goblets; i++)
+        goblets.Add(Stmt("Goblet %", i), 0.2f + 0.1f * i);
+    scale.Goblets = options.Goblets;
+
+    WaitersTableMediator waiters(db);
+    for(int i = 0; i < options.Waiters; i++)
+        waiters.Add(Stmt("% %", FirstNames[i % std::size(FirstNames)], i), 800.0f + random() % 1200, 18 + random() % 40);
+    scale.Waiters = options.Waiters;
+
+    OrdersLogTableMediator orders(db);
+    DrinkOrdersTableMediator drink_orders(db);
+    const int first_order = (int)orders.ReserveIDs(options.Orders);
+    for(int i = 0; i < options.Orders; i++){
+        const int drinks_count = 1 + random() % 5;
+        const float checkout = drinks_count * (2.0f + (random() % 1500) / 100.0f);
+        const float tips = checkout * (random() % 20) / 100.0f;
+        const String customer = StringPrint("% %", FirstNames[random() % std::size(FirstNames)], random() % 5000);
+
+        const int order = orders.Add(first_order + i, customer.Data(), tips, 1 + random() % options.Waiters, checkout, RandomDate(random, options));
+        for(int j = 0; j < drinks_count; j++)
+            drink_orders.Add(order, first_drink + random() % options.Drinks, 1 + random() % options.Goblets);
+        scale.DrinkOrders += drinks_count;
+
+        if((i + 1) % 100000 == 0)
+            fprintf(stderr, "  %d orders\n", i + 1);
+    }
+    scale.Orders = options.Orders;
+
+    transaction.Commit();
+    return scale;
+}
+
+struct OperationResult{
+    std::string Name;
+    size_t Iterations = 0;
+    uint64_t Rows = 0;
+    double OpsPerSecond = 0;
+    double MeanUs = 0;
+    double P50Us = 0;
+    double P90Us = 0;
+    double P99Us = 0;
+    double MaxUs = 0;
+};
+
+// 'operation' returns the number of rows it produced or wrote
+template<typename OperationType>
+static OperationResult Measure(const char *name, const BenchOptions &options, OperationType operation){
+    OperationResult result;
+    result.Name = name;
+
+    std::vector<double> samples;
+    const auto budget = std::chrono::duration<double>(options.Seconds);
+    const auto begin = BenchClock::now();
+    while(samples.size() < MinIterations || (BenchClock::now() - begin < budget && samples.size() < MaxIterations)){
+        const auto start = BenchClock::now();
+        result.Rows += operation(samples.size());
+        samples.push_back(std::chrono::duration<double, std::micro>(BenchClock::now() - start).count());
+    }
+
+    double total = 0;
+    for(double sample: samples)
+        total += sample;
+    std::sort(samples.begin(), samples.end());
+
+    auto percentile = [&](double p){
+        return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))];
+    };
+
+    result.Iterations = samples.size();
+    result.OpsPerSecond = samples.size() / (total / 1000000.0);
+    result.MeanUs = total / samples.size();
+    result.P50Us = percentile(0.50);
+    result.P90Us = percentile(0.90);
+    result.P99Us = percentile(0.99);
+    result.MaxUs = samples.back();
+
+    fprintf(stderr, "  %-40s %8zu runs  mean %10.1f us  p99 %10.1f us\n", name, result.Iterations, result.MeanUs, result.P99Us);
+    return result;
+}
+
+template<typename ResultType>
+static uint64_t Drain(ResultType query){
+    uint64_t rows = 0;
+    for(; query; query.Next()){
+        auto row = query.Current();
+        (void)row;
+        rows++;
+    }
+    return rows;
+}
+
+static std::vector<OperationResult> RunOperations(Database &db, const BenchOptions &options, const Scale &scale){
+    std::vector<OperationResult> results;
+    std::mt19937 random(7);
+
+    AddressesTableMediator addresses(db);
+    SourcesTableMediator sources(db);
+    IngredientsTableMediator ingredients(db);
+    IngredientsDrinksTableMediator recipes(db);
+    DrinksTableMediator drinks(db);
+    GobletsTableMediator goblets(db);
+    WaitersTableMediator waiters(db);
+    OrdersLogTableMediator orders(db);
+    DrinkOrdersTableMediator drink_orders(db);
+    StoredProcedures procedures(db);
+
+    auto any = [&](int count){ return 1 + (int)(random() % std::max(count, 1)); };
+    auto month = [&](){
+        const Date begin = RandomDate(random, options);
+        return std::make_pair(Date{1, begin.Month, begin.Year}, Date{28, begin.Month, begin.Year});
+    };
+
+    results.push_back(Measure("addresses.query_by_id", options, [&](size_t){ return Drain(addresses.Query(any(addresses.Size()))); }));
+    results.push_back(Measure("addresses.query_by_location", options, [&](size_t i){ return Drain(addresses.Query(Cities[i % std::size(Cities)], "1", 79000)); }));
+    results.push_back(Measure("sources.query_all", options, [&](size_t){ return Drain(sources.Query()); }));
+    results.push_back(Measure("sources.query_by_id", options, [&](size_t){ return Drain(sources.Query(any(sources.Size()))); }));
+    results.push_back(Measure("ingredients.query_all", options, [&](size_t){ return Drain(ingredients.Query()); }));
+    results.push_back(Measure("ingredients.query_by_id", options, [&](size_t){ return Drain(ingredients.Query(any(scale.Ingredients))); }));
+    results.push_back(Measure("ingredients_drinks.query_by_drink", options, [&](size_t){ return Drain(recipes.Query(any(scale.Drinks))); }));
+    results.push_back(Measure("drinks.query_all", options, [&](size_t){ return Drain(drinks.Query()); }));
+    results.push_back(Measure("drinks.query_by_id", options, [&](size_t){ return Drain(drinks.Query(any(scale.Drinks))); }));
+    results.push_back(Measure("drinks.query_by_name", options, [&](size_t){
+        auto drink = drinks.Query(any(scale.Drinks));
+        const std::string name = drink ? drink.Current().Name : "";
+        return Drain(drinks.Query(name.c_str()));
+    }));
+    results.push_back(Measure("goblets.query_all", options, [&](size_t){ return Drain(goblets.Query()); }));
+    results.push_back(Measure("goblets.query_by_id", options, [&](size_t){ return Drain(goblets.Query(any(scale.Goblets))); }));
+    results.push_back(Measure("goblets.query_by_name", options, [&](size_t i){ return Drain(goblets.Query(Stmt("Goblet %", i % scale.Goblets))); }));
+    results.push_back(Measure("waiters.query_all", options, [&](size_t){ return Drain(waiters.Query()); }));
+    results.push_back(Measure("waiters.query_by_id", options, [&](size_t){ return Drain(waiters.Query(any(scale.Waiters))); }));
+    results.push_back(Measure("waiters.query_by_name", options, [&](size_t i){
+        return Drain(waiters.Query(Stmt("% %", FirstNames[i % scale.Waiters % std::size(FirstNames)], i % scale.Waiters)));
+    }));
+    results.push_back(Measure("waiters.exists", options, [&](size_t i){ return (uint64_t)waiters.Exists(Stmt("% %", FirstNames[i % std::size(FirstNames)], i)); }));
+    results.push_back(Measure("orders_log.query_all", options, [&](size_t){ return Drain(orders.Query()); }));
+    results.push_back(Measure("orders_log.query_month", options, [&](size_t){
+        const auto [begin, end] = month();
+        return Drain(orders.Query(begin, end));
+    }));
+    results.push_back(Measure("orders_log.size", options, [&](size_t){ return (uint64_t)orders.Size(); }));
+    results.push_back(Measure("drink_orders.query_by_order", options, [&](size_t){ return Drain(drink_orders.Query(any(scale.Orders))); }));
+
+    results.push_back(Measure("procedures.sources_with_city", options, [&](size_t i){ return Drain(procedures.GetAllSourcesWithCity(Cities[i % std::size(Cities)])); }));
+    results.push_back(Measure("procedures.expensive_waiters", options, [&](size_t){ return Drain(procedures.GetExpensiveWaiters(1800.0f)); }));
+    results.push_back(Measure("procedures.drinks_with", options, [&](size_t i){
+        return Drain(procedures.GetDrinksWith(Stmt("% #%", IngredientKinds[i % std::size(IngredientKinds)][0], i % scale.Ingredients)));
+    }));
+    results.push_back(Measure("procedures.ingredients_cheaper_than", options, [&](size_t){ return Drain(procedures.GetIngredientsWithPriceLessThan(2.0f)); }));
+    results.push_back(Measure("procedures.goblets_larger_than", options, [&](size_t){ return Drain(procedures.GetGobletWithCapacityMoreThan(1.0f)); }));
+    results.push_back(Measure("procedures.orders_count_by_waiter", options, [&](size_t){
+        const auto [begin, end] = month();
+        return Drain(procedures.GetOrdersCountByWaiter(begin, end));
+    }));
+    results.push_back(Measure("procedures.orders_count_by_waiter_all_years", options, [&](size_t){
+        return Drain(procedures.GetOrdersCountByWaiter(Date{1, 1, options.LastYear - options.Years + 1}, Date{28, 12, options.LastYear}));
+    }));
+    results.push_back(Measure("procedures.drinks_sold_count", options, [&](size_t){
+        const auto [begin, end] = month();
+        return Drain(procedures.GetDrinksSoldCount(begin, end));
+    }));
+
+    // Writes come last, each one is its own transaction as it is in the UI
+    results.push_back(Measure("addresses.try_add", options, [&](size_t i){ return (uint64_t)(addresses.TryAdd("Bench", Stmt("%", i), (int)i) > 0); }));
+    results.push_back(Measure("sources.add", options, [&](size_t i){ return (uint64_t)(sources.Add(Stmt("Bench Source %", i), 1) > 0); }));
+    results.push_back(Measure("ingredients.add", options, [&](size_t i){ return (uint64_t)(ingredients.Add(Stmt("Bench Ingredient %", i), "kg", 1) > 0); }));
+    results.push_back(Measure("ingredients_drinks.add", options, [&](size_t){ recipes.Add(any(scale.Ingredients), 1.0f, any(scale.Drinks)); return 1; }));
+    results.push_back(Measure("drinks.add", options, [&](size_t i){ return (uint64_t)(drinks.Add(Stmt("Bench Drink %", i), 5.0f, 0) > 0); }));
+    results.push_back(Measure("goblets.add", options, [&](size_t i){ goblets.Add(Stmt("Bench Goblet %", i), 0.5f); return 1; }));
+    results.push_back(Measure("waiters.add", options, [&](size_t i){ return (uint64_t)(waiters.Add(Stmt("Bench Waiter %", i), 1000.0f, 30) > 0); }));
+    results.push_back(Measure("orders_log.add", options, [&](size_t){
+        return (uint64_t)(orders.Add("Bench Customer", 1.0f, any(scale.Waiters), 10.0f, RandomDate(random, options)) > 0);
+    }));
+    results.push_back(Measure("drink_orders.add", options, [&](size_t){ return (uint64_t)drink_orders.Add(any(scale.Orders), any(scale.Drinks), any(scale.Goblets)); }));
+
+    return results;
+}
+
+static void WriteJson(FILE *file, const BenchOptions &options, const Scale &scale, double generation_seconds, const std::vector<OperationResult> &results){
+    fprintf(file, "{\n");
+    fprintf(file, "  \"sqlite_version\": \"%s\",\n", sqlite3_libversion());
+    fprintf(file, "  \"scale\": {\"waiters\": %d, \"drinks\": %d, \"recipe_rows\": %d, \"ingredients\": %d, \"goblets\": %d, \"orders\": %d, \"drink_orders\": %d, \"years\": %d},\n",
+        scale.Waiters, scale.Drinks, scale.Recipes, scale.Ingredients, scale.Goblets, scale.Orders, scale.DrinkOrders, options.Years);
+    fprintf(file, "  \"generation_seconds\": %.3f,\n", generation_seconds);
+    fprintf(file, "  \"seconds_per_operation\": %.3f,\n", options.Seconds);
+    fprintf(file, "  \"operations\": [\n");
+    for(size_t i = 0; i < results.size(); i++){
+        const OperationResult &result = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"iterations\": %zu, \"rows\": %llu, \"ops_per_second\": %.1f, "
+                      "\"mean_us\": %.2f, \"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}%s\n",
+            result.Name.c_str(), result.Iterations, (unsigned long long)result.Rows, result.OpsPerSecond,
+            result.MeanUs, result.P50Us, result.P90Us, result.P99Us, result.MaxUs, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+static bool ParseOptions(int argc, char **argv, BenchOptions &options){
+    for(int i = 1; i < argc; i++){
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if(!strcmp(arg, "--reuse")){
+            options.Reuse = true;
+            continue;
+        }
+        if(!value)
+            return false;
+        i++;
+
+        if(!strcmp(arg, "--orders"))
+            options.Orders = atoi(value);
+        else if(!strcmp(arg, "--waiters"))
+            options.Waiters = atoi(value);
+        else if(!strcmp(arg, "--drinks"))
+            options.Drinks = atoi(value);
+        else if(!strcmp(arg, "--ingredients"))
+            options.Ingredients = atoi(value);
+        else if(!strcmp(arg, "--years"))
+            options.Years = atoi(value);
+        else if(!strcmp(arg, "--seconds"))
+            options.Seconds = atof(value);
+        else if(!strcmp(arg, "--database"))
+            options.Database = value;
+        else if(!strcmp(arg, "--output"))
+            options.Output = value;
+        else
+            return false;
+    }
+    return options.Orders > 0 && options.Waiters > 0 && options.Drinks > 0 && options.Ingredients > 0 && options.Years > 0;
+}
+
+static Scale CountScale(Database &db){
+    Scale scale;
+    scale.Waiters = (int)db.Size("Waiters");
+    scale.Drinks = (int)db.Size("Drinks");
+    scale.Recipes = (int)db.Size("IngredientsDrinks");
+    scale.Ingredients = (int)db.Size("Ingredients");
+    scale.Goblets = (int)db.Size("Goblets");
+    scale.Orders = (int)db.Size("OrdersLog");
+    scale.DrinkOrders = (int)db.Size("DrinkOrders");
+    return scale;
+}
+
+int main(int argc, char **argv){
+    BenchOptions options;
+    if(!ParseOptions(argc, argv, options)){
+        fprintf(stderr, "usage: BreweryBench [--orders N] [--waiters N] [--drinks N] [--ingredients N] [--years N] "
+                        "[--seconds S] [--database path] [--reuse] [--output results.json]\n");
+        return 1;
+    }
+
+    if(!options.Reuse){
+        remove(options.Database);
+        remove(StringPrint("%-wal", options.Database).Data());
+        remove(StringPrint("%-shm", options.Database).Data());
+    }
+
+    DatabaseLogger logger;
+    Database db(options.Database, logger);
+    SchemaMigrator schema(db, logger);
+    if(!schema.IsMigrated()){
+        for(size_t i = 0; i < logger.Size(); i++)
+            fprintf(stderr, "%s\n", logger[i]);
+        return 1;
+    }
+
+    Scale scale;
+    double generation_seconds = 0;
+    if(options.Reuse && db.Size("OrdersLog")){
+        scale = CountScale(db);
+    }else{
+        fprintf(stderr, "Generating %d orders over %d years\n", options.Orders, options.Years);
+        const auto begin = BenchClock::now();
+        scale = Generate(db, options);
+        generation_seconds = std::chrono::duration<double>(BenchClock::now() - begin).count();
+        db.Execute("PRAGMA optimize");
+    }
+    // Everything the generator committed is in the WAL, readers should not have to walk it
+    db.Checkpoint();
+
+    fprintf(stderr, "Measuring, %.1f s per operation\n", options.Seconds);
+    const std::vector<OperationResult> results = RunOperations(db, options, scale);
+
+    FILE *output = options.Output ? fopen(options.Output, "w") : stdout;
+    if(!output){
+        fprintf(stderr, "Can't open %s\n", options.Output);
+        return 1;
+    }
+    WriteJson(output, options, scale, generation_seconds, results);
+    if(output != stdout)
+        fclose(output);
+
+    for(size_t i = 0; i < logger.Size(); i++)
+        fprintf(stderr, "%s\n", logger[i]);
+}
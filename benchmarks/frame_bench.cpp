@@ -0,0 +1,232 @@
+#include "workspace.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+    #include <time.h>
+#endif
+
+// Draws every panel of the application for a number of frames with an ImGui
+// context that has no rendering backend, and reports per panel and frame the
+// CPU time, the statements run and the allocations made. Results go out as
+// JSON, a summary to stderr:
+//     BreweryFrameBench [database.sqlite] [--frames N] [--warmup N] [--output results.json]
+
+using BenchClock = std::chrono::steady_clock;
+
+static constexpr int DisplayWidth = 1280;
+static constexpr int DisplayHeight = 720;
+static constexpr auto LoadTimeout = std::chrono::seconds(120);
+
+// Only the thread that draws is counted, the background workers allocate too
+static thread_local uint64_t s_Allocations = 0;
+
+void *operator new(size_t size){
+    s_Allocations++;
+    if(void *memory = malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory)noexcept{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t)noexcept{
+    free(memory);
+}
+
+static int64_t ThreadCpuNs(){
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    auto ticks = [](FILETIME time){ return (int64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) * 100;
+#else
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return int64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+#endif
+}
+
+struct PanelStats{
+    std::string Name;
+    std::vector<double> CpuUs;
+    std::vector<double> WallUs;
+    uint64_t Statements = 0;
+    uint64_t Allocations = 0;
+
+    double Percentile(std::vector<double> samples, double percentile)const{
+        if(samples.empty())
+            return 0;
+        std::sort(samples.begin(), samples.end());
+        return samples[std::min(samples.size() - 1, (size_t)(percentile * samples.size()))];
+    }
+
+    static double Mean(const std::vector<double> &samples){
+        double total = 0;
+        for(double sample: samples)
+            total += sample;
+        return samples.size() ? total / samples.size() : 0;
+    }
+};
+
+class FrameRecorder{
+private:
+    QueryProfiler &m_Profiler;
+    std::vector<PanelStats> m_Panels;
+    size_t m_Next = 0;
+    bool m_IsRecording = false;
+public:
+    FrameRecorder(QueryProfiler &profiler):
+        m_Profiler(profiler)
+    {}
+
+    void BeginFrame(bool is_recording){
+        m_Next = 0;
+        m_IsRecording = is_recording;
+    }
+
+    template<typename DrawType>
+    void Measure(const char *name, DrawType draw){
+        const uint64_t statements = m_Profiler.TotalCalls();
+        const uint64_t allocations = s_Allocations;
+        const int64_t cpu = ThreadCpuNs();
+        const auto wall = BenchClock::now();
+
+        draw();
+
+        const double wall_us = std::chrono::duration<double, std::micro>(BenchClock::now() - wall).count();
+        const double cpu_us = (ThreadCpuNs() - cpu) / 1000.0;
+
+        if(m_Next == m_Panels.size())
+            m_Panels.push_back({name});
+        PanelStats &panel = m_Panels[m_Next++];
+        if(!m_IsRecording)
+            return;
+
+        panel.CpuUs.push_back(cpu_us);
+        panel.WallUs.push_back(wall_us);
+        panel.Statements += m_Profiler.TotalCalls() - statements;
+        panel.Allocations += s_Allocations - allocations;
+    }
+
+    const std::vector<PanelStats> &Panels()const{
+        return m_Panels;
+    }
+};
+
+static void WriteJson(FILE *file, const char *database, int frames, const std::vector<PanelStats> &panels){
+    fprintf(file, "{\n");
+    fprintf(file, "  \"database\": \"%s\",\n", database);
+    fprintf(file, "  \"frames\": %d,\n", frames);
+    fprintf(file, "  \"display\": [%d, %d],\n", DisplayWidth, DisplayHeight);
+    fprintf(file, "  \"panels\": [\n");
+    for(size_t i = 0; i < panels.size(); i++){
+        const PanelStats &panel = panels[i];
+        fprintf(file, "    {\"name\": \"%s\", \"cpu_mean_us\": %.2f, \"cpu_p50_us\": %.2f, \"cpu_p99_us\": %.2f, \"wall_mean_us\": %.2f, "
+                      "\"wall_p99_us\": %.2f, \"statements_per_frame\": %.2f, \"allocations_per_frame\": %.2f}%s\n",
+            panel.Name.c_str(), PanelStats::Mean(panel.CpuUs), panel.Percentile(panel.CpuUs, 0.50), panel.Percentile(panel.CpuUs, 0.99),
+            PanelStats::Mean(panel.WallUs), panel.Percentile(panel.WallUs, 0.99),
+            (double)panel.Statements / frames, (double)panel.Allocations / frames, i + 1 < panels.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char **argv){
+    const char *database = "brewery_bench.sqlite";
+    const char *output = nullptr;
+    int frames = 300;
+    int warmup = 30;
+
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--warmup") && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if(argv[i][0] != '-')
+            database = argv[i];
+        else{
+            fprintf(stderr, "usage: BreweryFrameBench [database.sqlite] [--frames N] [--warmup N] [--output results.json]\n");
+            return 1;
+        }
+    }
+    frames = std::max(frames, 1);
+
+    ImGui::CreateContext();
+    ImPlot::CreateContext();
+
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = ImVec2(DisplayWidth, DisplayHeight);
+    io.DeltaTime = 1.f / 60.f;
+    io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
+    // Same docked layout the application starts with
+    ImGui::LoadIniSettingsFromDisk("imgui.ini");
+
+    // The atlas is built on the CPU and never uploaded
+    unsigned char *pixels = nullptr;
+    int width = 0, height = 0;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    {
+        Workspace workspace(database);
+        Dockspace dockspace(Vector2s(DisplayWidth, DisplayHeight));
+        FrameRecorder recorder(workspace.GetDatabase().Profiler());
+
+        fprintf(stderr, "%s: %zu orders\n", database, workspace.GetDatabase().Size("OrdersLog"));
+
+        auto frame = [&](bool is_recording){
+            ImGui::NewFrame();
+            recorder.BeginFrame(is_recording);
+            recorder.Measure("Dockspace", [&](){ dockspace.Draw(); });
+            workspace.ForEachPanel([&](const char *name, auto &panel){
+                recorder.Measure(name, [&](){ panel.Draw(); });
+            });
+            recorder.Measure("ImGui::Render", [&](){ ImGui::Render(); });
+            recorder.Measure("Writes", [&](){ workspace.EndFrame(); });
+        };
+
+        const auto load_begin = BenchClock::now();
+        while(!workspace.IsLoaded() && BenchClock::now() - load_begin < LoadTimeout){
+            frame(false);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        fprintf(stderr, "Loaded in %.2f s\n", std::chrono::duration<double>(BenchClock::now() - load_begin).count());
+
+        for(int i = 0; i < warmup; i++)
+            frame(false);
+        for(int i = 0; i < frames; i++)
+            frame(true);
+
+        for(const PanelStats &panel: recorder.Panels()){
+            fprintf(stderr, "  %-18s cpu mean %9.1f us  p99 %9.1f us  %7.1f statements  %9.1f allocations per frame\n",
+                panel.Name.c_str(), PanelStats::Mean(panel.CpuUs), panel.Percentile(panel.CpuUs, 0.99),
+                (double)panel.Statements / frames, (double)panel.Allocations / frames);
+        }
+
+        FILE *file = output ? fopen(output, "w") : stdout;
+        if(!file){
+            fprintf(stderr, "Can't open %s\n", output);
+            return 1;
+        }
+        WriteJson(file, database, frames, recorder.Panels());
+        if(file != stdout)
+            fclose(file);
+
+        DatabaseLogger &logger = workspace.GetLogger();
+        for(size_t i = 0; i < logger.Size(); i++)
+            fprintf(stderr, "%s\n", logger[i]);
+    }
+
+    ImPlot::DestroyContext();
+    ImGui::DestroyContext();
+}
@@ -0,0 +1,76 @@
+#include "mediators.cpp"
+#include <chrono>
+#include <cstdio>
+
+// Compares decoding OrdersLog rows through hand-written QueryResult getters
+// against the compile-time TypedQueryResult decoder.
+
+using BenchClock = std::chrono::steady_clock;
+
+static constexpr int RowsCount = 200000;
+static constexpr int Passes = 20;
+
+template<typename ScanType>
+void Measure(const char *name, ScanType scan){
+    double checksum = 0;
+    scan(checksum);
+
+    auto begin = BenchClock::now();
+    for(int i = 0; i < Passes; i++)
+        scan(checksum);
+    auto end = BenchClock::now();
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count();
+    printf("%-24s %8.2f ns/row  (checksum %.0f)\n", name, nanoseconds / (double(RowsCount) * Passes), checksum);
+}
+
+int main(){
+    DatabaseLogger logger;
+    Database db(":memory:", logger);
+
+    db.Execute("CREATE TABLE OrdersLog(ID int PRIMARY KEY NOT NULL, CustomerShortName varchar(64), Tips float, WaiterID int, Checkout float, OrderDate date)");
+    db.Execute("BEGIN");
+    for(int i = 0; i < RowsCount; i++)
+        db.Execute("INSERT INTO OrdersLog VALUES(?, ?, ?, ?, ?, ?)", i, "Customer", i * 0.25, i % 16, i * 1.5, "2022-1-1");
+    db.Execute("COMMIT");
+
+    OrdersLogTableMediator orders(db);
+
+    Measure("QueryResult getters", [&](double &checksum){
+        auto query = db.Query(TableStatements<OrderRow>::Select.Data);
+        for(; query; query.Next()){
+            checksum += query.GetColumnInt(0);
+            checksum += query.GetColumnString(1)[0];
+            checksum += query.GetColumnFloat(2);
+            checksum += query.GetColumnInt(3);
+            checksum += query.GetColumnFloat(4);
+            checksum += query.GetColumnString(5)[0];
+        }
+    });
+
+    Measure("TypedQueryResult struct", [&](double &checksum){
+        for(auto query = orders.Query(); query; query.Next()){
+            OrderRow order = query.Current();
+            checksum += order.ID;
+            checksum += order.CustomerShortName[0];
+            checksum += order.Tips;
+            checksum += order.WaiterID;
+            checksum += order.Checkout;
+            checksum += order.OrderDate[0];
+        }
+    });
+
+    Measure("TypedQueryResult tuple", [&](double &checksum){
+        using Row = TableRow<int, const char *, float, int, float, const char *>;
+        TypedQueryResult<Row> query = db.Query(TableStatements<OrderRow>::Select.Data);
+        for(; query; query.Next()){
+            auto [id, name, tips, waiter_id, checkout, date] = query.Current();
+            checksum += id + name[0] + tips + waiter_id + checkout + date[0];
+        }
+    });
+
+    for(size_t i = 0; i < logger.Size(); i++)
+        printf("%s\n", logger[i]);
+
+    return 0;
+}
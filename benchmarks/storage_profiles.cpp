@@ -0,0 +1,155 @@
+#include "mediators.cpp"
+#include "transaction.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// Read latency of the analytics and list queries under storage profiles and
+// page sizes. Runs on a copy of the given database, or on a generated one:
+//     BreweryStorageBench [database.sqlite | orders_count]
+
+using BenchClock = std::chrono::steady_clock;
+
+static constexpr int Passes = 30;
+static constexpr int LookupsPerPass = 20;
+static constexpr int DefaultOrdersCount = 200000;
+
+struct NamedProfile{
+    const char *Name;
+    StorageProfile Profile;
+};
+
+static void Generate(const char *filepath, int orders_count){
+    remove(filepath);
+
+    DatabaseLogger logger;
+    Database db(filepath, logger);
+
+    db.Execute(
+        "CREATE TABLE Waiters(ID int PRIMARY KEY NOT NULL, ShortName varchar(64), Salary float, FullAge int);"
+        "CREATE TABLE Drinks(ID int PRIMARY KEY NOT NULL, Name varchar(64), PricePerLiter float, AgeRestriction int);"
+        "CREATE TABLE Goblets(ID int PRIMARY KEY NOT NULL, Name varchar(64), Capacity float);"
+        "CREATE TABLE OrdersLog(ID int PRIMARY KEY NOT NULL, CustomerShortName varchar(64), Tips float, WaiterID int, Checkout float, OrderDate date);"
+        "CREATE TABLE DrinkOrders(OrderID int, DrinkID int, GobletID int);"
+    );
+
+    Transaction transaction(db);
+    for(int i = 1; i <= 16; i++){
+        db.Execute("INSERT INTO Waiters VALUES(?, ?, ?, ?)", i, Stmt("Waiter%", i), 1000.0 + i, 20 + i);
+        db.Execute("INSERT INTO Drinks VALUES(?, ?, ?, ?)", i, Stmt("Drink%", i), 2.5 * i, i % 2 ? 18 : 0);
+        db.Execute("INSERT INTO Goblets VALUES(?, ?, ?)", i, Stmt("Goblet%", i), 0.25 * i);
+    }
+
+    std::mt19937 random(42);
+    for(int i = 1; i <= orders_count; i++){
+        const String date = StringPrint("%-%-%", 2020 + random() % 4, 1 + random() % 12, 1 + random() % 28);
+        db.Execute("INSERT INTO OrdersLog VALUES(?, ?, ?, ?, ?, ?)", i, Stmt("Customer%", random() % 5000), (random() % 100) / 10.0, 1 + (int)(random() % 16), (random() % 10000) / 10.0, date.Data());
+        for(int drink = 0; drink < 3; drink++)
+            db.Execute("INSERT INTO DrinkOrders VALUES(?, ?, ?)", i, 1 + (int)(random() % 16), 1 + (int)(random() % 16));
+    }
+    transaction.Commit();
+}
+
+template<typename QueryType>
+static void Measure(const char *name, QueryType query){
+    std::vector<double> samples;
+    double checksum = 0;
+
+    query(checksum);
+    for(int i = 0; i < Passes; i++){
+        const auto begin = BenchClock::now();
+        query(checksum);
+        samples.push_back(std::chrono::duration<double, std::milli>(BenchClock::now() - begin).count());
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for(double sample: samples)
+        sum += sample;
+
+    printf("    %-28s mean %9.3f ms  p99 %9.3f ms  (checksum %.0f)\n", name, sum / samples.size(), samples[samples.size() * 99 / 100], checksum);
+}
+
+static void Run(const char *filepath, const NamedProfile &named){
+    DatabaseLogger logger;
+    Database db(filepath, logger, SQLITE_OPEN_READONLY);
+    db.Configure(named.Profile);
+
+    printf("  %s, page size %d\n", named.Name, db.PageSize());
+
+    const Date begin{1, 1, 2020};
+    const Date end{1, 1, 2024};
+    const int orders_count = (int)db.Size(TableSchema<OrderRow>::Name);
+
+    Measure("orders by waiter", [&](double &checksum){
+        auto result = StoredProcedures(db).GetOrdersCountByWaiter(begin, end).Materialize();
+        for(size_t i = 0; i < result.Size(); i++)
+            checksum += std::get<1>(result[i]);
+    });
+
+    Measure("drinks sold", [&](double &checksum){
+        auto result = StoredProcedures(db).GetDrinksSoldCount(begin, end).Materialize();
+        for(size_t i = 0; i < result.Size(); i++)
+            checksum += std::get<1>(result[i]);
+    });
+
+    OrdersLogTableMediator orders(db);
+    Measure("orders log list", [&](double &checksum){
+        for(auto query = orders.Query(); query; query.Next())
+            checksum += query.Current().Checkout;
+    });
+
+    DrinkOrdersTableMediator drink_orders(db);
+    std::mt19937 random(7);
+    Measure("drink orders by order", [&](double &checksum){
+        for(int i = 0; i < LookupsPerPass; i++){
+            for(auto query = drink_orders.Query(1 + random() % std::max(orders_count, 1)); query; query.Next())
+                checksum += query.Current().DrinkID;
+        }
+    });
+}
+
+int main(int argc, char **argv){
+    const char *generated = "storage_bench_source.sqlite";
+    const char *source = generated;
+
+    if(argc > 1 && strstr(argv[1], ".sqlite")){
+        source = argv[1];
+    }else{
+        const int orders_count = argc > 1 ? atoi(argv[1]) : DefaultOrdersCount;
+        printf("Generating %d orders\n", orders_count);
+        Generate(generated, orders_count);
+    }
+
+    const NamedProfile profiles[] = {
+        {"defaults", StorageProfile::Defaults()},
+        {"large cache", [](){ auto profile = StorageProfile::Defaults(); profile.CacheSizeKiB = 64 * 1024; return profile; }()},
+        {"mmap", [](){ auto profile = StorageProfile::Defaults(); profile.MmapSize = 256 * 1024 * 1024; return profile; }()},
+        {"read heavy", StorageProfile::ReadHeavy()},
+    };
+
+    for(int page_size: {4096, 16384, 65536}){
+        const String copy = StringPrint("storage_bench_%.sqlite", page_size);
+        remove(copy.Data());
+        {
+            DatabaseLogger logger;
+            Database db(source, logger, SQLITE_OPEN_READONLY);
+            StorageProfile layout;
+            layout.PageSize = page_size;
+            db.Configure(layout);
+            if(!db.VacuumInto(copy.Data())){
+                printf("Can't copy %s: %s\n", source, logger.Size() ? logger.Last() : "");
+                return 1;
+            }
+        }
+
+        for(const NamedProfile &profile: profiles)
+            Run(copy.Data(), profile);
+
+        remove(copy.Data());
+    }
+
+    if(source == generated)
+        remove(generated);
+}
@@ -0,0 +1,115 @@
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <cstdio>
+
+// Copies a live database file on a read-only connection and thread of its own.
+// Pages go over in small steps with a pause in between, so the copy competes
+// with the UI for neither locks nor disk bandwidth. The copy is written next to
+// the destination and renamed over it once complete.
+class OnlineBackup{
+public:
+    enum class State{
+        Running,
+        Done,
+        Failed,
+        Cancelled
+    };
+
+    struct Progress{
+        int CopiedPages = 0;
+        int TotalPages = 0;
+    };
+
+    static constexpr int DefaultPagesPerStep = 256;
+    static constexpr auto DefaultStepPause = std::chrono::milliseconds(2);
+private:
+    std::string m_FilePath;
+    std::string m_PartialPath;
+    int m_PagesPerStep;
+    std::chrono::steady_clock::duration m_StepPause;
+
+    DatabaseLogger m_Logger;
+    Database m_Database;
+
+    std::atomic<int> m_CopiedPages{0};
+    std::atomic<int> m_TotalPages{0};
+    std::atomic<State> m_State{State::Running};
+    std::atomic<bool> m_IsCancelled{false};
+
+    std::thread m_Worker;
+public:
+    OnlineBackup(const char *database_path, const char *filepath, int pages_per_step = DefaultPagesPerStep, std::chrono::steady_clock::duration step_pause = DefaultStepPause):
+        m_FilePath(filepath),
+        m_PartialPath(m_FilePath + ".partial"),
+        m_PagesPerStep(pages_per_step),
+        m_StepPause(step_pause),
+        m_Database(database_path, m_Logger, SQLITE_OPEN_READONLY),
+        m_Worker(&OnlineBackup::WorkerMain, this)
+    {}
+
+    OnlineBackup(const OnlineBackup &) = delete;
+
+    OnlineBackup &operator=(const OnlineBackup &) = delete;
+
+    ~OnlineBackup(){
+        Cancel();
+        m_Worker.join();
+    }
+
+    void Cancel(){
+        m_IsCancelled = true;
+    }
+
+    State GetState()const{
+        return m_State.load(std::memory_order_acquire);
+    }
+
+    bool IsRunning()const{
+        return GetState() == State::Running;
+    }
+
+    Progress GetProgress()const{
+        return {m_CopiedPages.load(std::memory_order_relaxed), m_TotalPages.load(std::memory_order_relaxed)};
+    }
+
+    // Errors of the backup, only to be pumped and read once it is no longer running
+    DatabaseLogger &Log(){
+        return m_Logger;
+    }
+
+    const std::string &FilePath()const{
+        return m_FilePath;
+    }
+private:
+    void WorkerMain(){
+        m_State.store(Backup(), std::memory_order_release);
+    }
+
+    State Backup(){
+        std::remove(m_PartialPath.c_str());
+
+        const bool is_copied = m_Database.BackupTo(m_PartialPath.c_str(), m_PagesPerStep, [this](int remaining, int total){
+            m_CopiedPages.store(total - remaining, std::memory_order_relaxed);
+            m_TotalPages.store(total, std::memory_order_relaxed);
+            if(m_IsCancelled)
+                return false;
+
+            std::this_thread::sleep_for(m_StepPause);
+            return true;
+        });
+
+        if(!is_copied){
+            std::remove(m_PartialPath.c_str());
+            return m_IsCancelled ? State::Cancelled : State::Failed;
+        }
+
+        std::remove(m_FilePath.c_str());
+        if(std::rename(m_PartialPath.c_str(), m_FilePath.c_str()) != 0){
+            m_Logger.Log("[Backup]: can't rename '%' to '%'", m_PartialPath.c_str(), m_FilePath.c_str());
+            return State::Failed;
+        }
+        return State::Done;
+    }
+};
@@ -0,0 +1,209 @@
+#include <sqlite3.h>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+
+// Bounded lock-free queue, any number of producers and a single consumer.
+// Each cell carries a sequence number telling whose turn it is, so a push
+// and a pop never touch the same cell at once.
+template<typename Type>
+class BoundedQueue{
+private:
+    struct Cell{
+        std::atomic<size_t> Sequence;
+        Type Value;
+    };
+
+    std::unique_ptr<Cell[]> m_Cells;
+    size_t m_Mask = 0;
+
+    alignas(64) std::atomic<size_t> m_Head{0};
+    alignas(64) std::atomic<size_t> m_Tail{0};
+public:
+    // Capacity is rounded up to a power of two
+    BoundedQueue(size_t capacity){
+        size_t size = 2;
+        while(size < capacity)
+            size *= 2;
+
+        m_Cells.reset(new Cell[size]);
+        m_Mask = size - 1;
+        for(size_t i = 0; i < size; i++)
+            m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    template<typename ValueType>
+    bool TryPush(ValueType &&value){
+        size_t position = m_Head.load(std::memory_order_relaxed);
+        for(;;){
+            Cell &cell = m_Cells[position & m_Mask];
+            const size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+            if(difference == 0){
+                if(m_Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    cell.Value = std::forward<ValueType>(value);
+                    cell.Sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }else if(difference < 0){
+                return false;
+            }else{
+                position = m_Head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Must only be called from the consumer thread
+    bool TryPop(Type &value){
+        const size_t position = m_Tail.load(std::memory_order_relaxed);
+        Cell &cell = m_Cells[position & m_Mask];
+        const size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+
+        if((intptr_t)sequence - (intptr_t)(position + 1) < 0)
+            return false;
+
+        value = std::move(cell.Value);
+        cell.Sequence.store(position + m_Mask + 1, std::memory_order_release);
+        m_Tail.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t Capacity()const{
+        return m_Mask + 1;
+    }
+};
+
+struct RowChange{
+    enum OperationType{
+        Insert = SQLITE_INSERT,
+        Delete = SQLITE_DELETE,
+        Update = SQLITE_UPDATE
+    };
+    // Interned by the stream, valid as long as the Database lives
+    const char *Table = nullptr;
+    int Operation = 0;
+    sqlite3_int64 RowID = 0;
+
+    bool IsOn(const char *table)const{
+        return Table && strcmp(Table, table) == 0;
+    }
+};
+
+// Consumer end of a change stream, polled from one thread
+class ChangeSubscription{
+private:
+    BoundedQueue<RowChange> m_Queue;
+    std::atomic<bool> m_IsOverflowed{false};
+
+    friend class ChangeStream;
+public:
+    ChangeSubscription(size_t capacity):
+        m_Queue(capacity)
+    {}
+
+    bool Poll(RowChange &change){
+        return m_Queue.TryPop(change);
+    }
+
+    // True once when changes were dropped because the queue was full,
+    // whatever the subscriber derived from the tables has to be rebuilt
+    bool ConsumeOverflow(){
+        return m_IsOverflowed.exchange(false, std::memory_order_acq_rel);
+    }
+};
+
+// Collects row changes reported by the connection hooks and hands them to
+// subscribers once their transaction is committed. Changes of rolled back
+// transactions are dropped, but rows undone by ROLLBACK TO or by a failed
+// statement are still reported, so consumers should treat a change as
+// "this row may differ now" and re-read it.
+class ChangeStream{
+public:
+    static constexpr size_t DefaultCapacity = 4096;
+private:
+    std::vector<std::unique_ptr<std::string>> m_Tables;
+    std::vector<RowChange> m_Pending;
+    std::vector<RowChange> m_Committed;
+
+    std::mutex m_SubscribersLock;
+    std::vector<std::weak_ptr<ChangeSubscription>> m_Subscribers;
+    std::atomic<bool> m_HasSubscribers{false};
+public:
+    std::shared_ptr<ChangeSubscription> Subscribe(size_t capacity = DefaultCapacity){
+        auto subscription = std::make_shared<ChangeSubscription>(capacity);
+        std::lock_guard<std::mutex> lock(m_SubscribersLock);
+        m_Subscribers.push_back(subscription);
+        m_HasSubscribers.store(true, std::memory_order_relaxed);
+        return subscription;
+    }
+
+    void OnRowChange(int operation, const char *table, sqlite3_int64 rowid){
+        if(!m_HasSubscribers.load(std::memory_order_relaxed))
+            return;
+        m_Pending.push_back({Intern(table), operation, rowid});
+    }
+
+    void OnCommit(){
+        m_Committed.insert(m_Committed.end(), m_Pending.begin(), m_Pending.end());
+        m_Pending.clear();
+    }
+
+    void OnRollback(){
+        m_Pending.clear();
+        m_Committed.clear();
+    }
+
+    // Subscribers have to rebuild, as if their queues overflowed
+    void Invalidate(){
+        std::lock_guard<std::mutex> lock(m_SubscribersLock);
+        for(const auto &subscriber: m_Subscribers){
+            if(auto subscription = subscriber.lock())
+                subscription->m_IsOverflowed.store(true, std::memory_order_release);
+        }
+    }
+
+    // The commit hook runs before the commit is visible to other connections,
+    // so changes are handed out only after the statement that committed returns
+    void Publish(){
+        if(m_Committed.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_SubscribersLock);
+        for(size_t i = 0; i < m_Subscribers.size();){
+            auto subscription = m_Subscribers[i].lock();
+            if(!subscription){
+                m_Subscribers.erase(m_Subscribers.begin() + i);
+                continue;
+            }
+
+            for(const RowChange &change: m_Committed){
+                if(!subscription->m_Queue.TryPush(change)){
+                    subscription->m_IsOverflowed.store(true, std::memory_order_release);
+                    break;
+                }
+            }
+            i++;
+        }
+        m_HasSubscribers.store(m_Subscribers.size(), std::memory_order_relaxed);
+        m_Committed.clear();
+    }
+private:
+    const char *Intern(const char *table){
+        for(const auto &name: m_Tables){
+            if(*name == table)
+                return name->c_str();
+        }
+        m_Tables.push_back(std::make_unique<std::string>(table));
+        return m_Tables.back()->c_str();
+    }
+};
@@ -1,5 +1,20 @@
 #include <sqlite3.h>
 #include <core/string_print.hpp>
+#include <core/list.hpp>
+#include <core/function.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cctype>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "changes.cpp"
+#include "profiler.cpp"
 
 class Stmt{
 private:
@@ -15,66 +30,569 @@ public:
     }
 };
 
+// Keeps the latest lines in a fixed arena, older ones are evicted, and written
+// to the spill file if there is one. Any thread may log: the consumer, the
+// thread that last called Pump(), appends directly, other threads hand their
+// lines over through a lock-free queue the consumer drains on Pump(). Lines
+// are only read and cleared by the consumer.
 class DatabaseLogger{
+public:
+    static constexpr size_t DefaultLinesCount = 4096;
+    static constexpr size_t DefaultArenaSize = 1024 * 1024;
+    static constexpr size_t IngressCapacity = 1024;
 private:
-    List<String> m_Lines;
+    struct Line{
+        size_t Offset;
+        size_t Length;
+    };
+
+    // Lines are null terminated and laid out in the order they came in,
+    // wrapping around once the end is reached
+    std::unique_ptr<char[]> m_Arena;
+    size_t m_ArenaSize = 0;
+    size_t m_ArenaHead = 0;
+
+    std::vector<Line> m_Lines;
+    size_t m_First = 0;
+    size_t m_Count = 0;
+
+    BoundedQueue<String> m_Ingress{IngressCapacity};
+    std::atomic<std::thread::id> m_Consumer{std::this_thread::get_id()};
+    std::atomic<size_t> m_Dropped{0};
+
+    std::FILE *m_SpillFile = nullptr;
 public:
+    DatabaseLogger(size_t lines_count = DefaultLinesCount, size_t arena_size = DefaultArenaSize):
+        m_Arena(new char[arena_size]),
+        m_ArenaSize(arena_size),
+        m_Lines(lines_count ? lines_count : 1)
+    {}
+
+    DatabaseLogger(const DatabaseLogger &) = delete;
+
+    DatabaseLogger &operator=(const DatabaseLogger &) = delete;
+
+    ~DatabaseLogger(){
+        if(m_SpillFile)
+            std::fclose(m_SpillFile);
+    }
 
     template<typename ...ArgsType>
     void Log(const char *fmt, ArgsType&&...args){
-        m_Lines.Add(StringPrint(fmt, Forward<ArgsType>(args)...));
+        String line = StringPrint(fmt, Forward<ArgsType>(args)...);
+        if(!IsConsumer())
+            return Enqueue(Move(line));
+
+        Pump();
+        Append(line.Data(), line.Size());
     }
 
-    void Log(const class QueryResult &result);
+    // Appends 'text' as it is, without formatting
+    void Write(const char *text){
+        if(!IsConsumer())
+            return Enqueue(String(text));
 
-    const List<String> &Lines()const{
-        return m_Lines;
+        Pump();
+        Append(text, std::strlen(text));
+    }
+
+    // Evicted lines are appended to 'filepath' from now on
+    bool SpillTo(const char *filepath){
+        if(m_SpillFile)
+            std::fclose(m_SpillFile);
+        m_SpillFile = std::fopen(filepath, "a");
+        return m_SpillFile;
+    }
+
+    // Moves in the lines other threads logged, the calling thread becomes the consumer
+    void Pump(){
+        m_Consumer.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+        String line;
+        while(m_Ingress.TryPop(line))
+            Append(line.Data(), line.Size());
+
+        if(const size_t dropped = m_Dropped.exchange(0, std::memory_order_relaxed)){
+            const String notice = StringPrint("[Logger]: % lines of other threads were dropped", dropped);
+            Append(notice.Data(), notice.Size());
+        }
+    }
+
+    size_t Size()const{
+        return m_Count;
+    }
+
+    // Oldest first, valid until the next line comes in
+    const char *operator[](size_t index)const{
+        return m_Arena.get() + m_Lines[(m_First + index) % m_Lines.size()].Offset;
+    }
+
+    const char *Last()const{
+        return (*this)[m_Count - 1];
     }
 
     void Clear(){
-        m_Lines.Clear();
+        Pump();
+        m_First = 0;
+        m_Count = 0;
+        m_ArenaHead = 0;
+    }
+private:
+    bool IsConsumer()const{
+        return m_Consumer.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+
+    void Enqueue(String line){
+        if(!m_Ingress.TryPush(Move(line)))
+            m_Dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Append(const char *text, size_t length){
+        length = std::min(length, m_ArenaSize - 1);
+
+        size_t offset = m_ArenaHead;
+        if(offset + length + 1 > m_ArenaSize){
+            // Lines past the wrap point are the oldest, they go before the ones it overwrites
+            while(m_Count && Oldest().Offset >= offset)
+                Evict();
+            offset = 0;
+        }
+        while(m_Count && (m_Count == m_Lines.size() || (Oldest().Offset < offset + length + 1 && Oldest().Offset >= offset)))
+            Evict();
+
+        std::memcpy(m_Arena.get() + offset, text, length);
+        m_Arena[offset + length] = 0;
+        m_Lines[(m_First + m_Count) % m_Lines.size()] = {offset, length};
+        m_Count++;
+        m_ArenaHead = offset + length + 1;
+    }
+
+    const Line &Oldest()const{
+        return m_Lines[m_First];
+    }
+
+    void Evict(){
+        if(m_SpillFile){
+            std::fwrite(m_Arena.get() + Oldest().Offset, 1, Oldest().Length, m_SpillFile);
+            std::fputc('\n', m_SpillFile);
+        }
+        m_First = (m_First + 1) % m_Lines.size();
+        m_Count--;
+    }
+};
+
+class StatementCache{
+public:
+    static constexpr size_t DefaultCapacity = 64;
+    static constexpr size_t TransientSlot = size_t(-1);
+
+    struct Stats{
+        size_t Hits = 0;
+        size_t Misses = 0;
+        size_t Evictions = 0;
+    };
+private:
+    struct Entry{
+        std::string Sql;
+        size_t Hash = 0;
+        sqlite3_stmt *Handle = nullptr;
+        bool InUse = false;
+        uint64_t LastUse = 0;
+    };
+
+    sqlite3 *m_Database;
+    std::vector<Entry> m_Entries;
+    std::string m_Key;
+    uint64_t m_Clock = 0;
+    Stats m_Stats;
+public:
+    StatementCache(sqlite3 *db, size_t capacity = DefaultCapacity):
+        m_Database(db),
+        m_Entries(capacity)
+    {}
+
+    StatementCache(const StatementCache &) = delete;
+
+    StatementCache &operator=(const StatementCache &) = delete;
+
+    ~StatementCache(){
+        Clear();
+    }
+
+    // Hands out a reset statement for the given sql, preparing it only on a miss.
+    // Statements that are still owned by someone else are never shared, a second
+    // user of the same text gets its own slot or a transient statement.
+    // 'is_complete' is false when the text holds more than one statement.
+    sqlite3_stmt *Acquire(const char *sql, size_t &slot, bool *is_complete = nullptr){
+        Normalize(sql, m_Key);
+        const size_t hash = std::hash<std::string_view>()(m_Key);
+
+        Entry *victim = nullptr;
+        for(Entry &entry: m_Entries){
+            if(entry.Handle && !entry.InUse && entry.Hash == hash && entry.Sql == m_Key){
+                m_Stats.Hits++;
+                entry.InUse = true;
+                entry.LastUse = ++m_Clock;
+                slot = &entry - m_Entries.data();
+                if(is_complete)
+                    *is_complete = true;
+                return entry.Handle;
+            }
+
+            if(entry.InUse)
+                continue;
+            if(!victim || !entry.Handle || (victim->Handle && entry.LastUse < victim->LastUse))
+                victim = &entry;
+        }
+
+        m_Stats.Misses++;
+
+        sqlite3_stmt *handle = nullptr;
+        const char *tail = nullptr;
+        if(sqlite3_prepare_v2(m_Database, m_Key.data(), (int)m_Key.size(), &handle, &tail) != SQLITE_OK)
+            return nullptr;
+
+        const bool complete = tail == m_Key.data() + m_Key.size();
+        if(is_complete)
+            *is_complete = complete;
+
+        if(!victim || !handle || !complete){
+            slot = TransientSlot;
+            return handle;
+        }
+
+        if(victim->Handle){
+            sqlite3_finalize(victim->Handle);
+            m_Stats.Evictions++;
+        }
+
+        victim->Sql = m_Key;
+        victim->Hash = hash;
+        victim->Handle = handle;
+        victim->InUse = true;
+        victim->LastUse = ++m_Clock;
+        slot = victim - m_Entries.data();
+        return handle;
+    }
+
+    void Release(sqlite3_stmt *handle, size_t slot){
+        if(slot == TransientSlot){
+            sqlite3_finalize(handle);
+            return;
+        }
+        sqlite3_reset(handle);
+        sqlite3_clear_bindings(handle);
+        m_Entries[slot].InUse = false;
+    }
+
+    void Clear(){
+        for(Entry &entry: m_Entries){
+            sqlite3_finalize(entry.Handle);
+            entry = {};
+        }
+    }
+
+    const Stats &GetStats()const{
+        return m_Stats;
+    }
+
+    void ResetStats(){
+        m_Stats = {};
+    }
+
+    size_t Capacity()const{
+        return m_Entries.size();
+    }
+
+    // Collapses whitespace and drops comments outside of literals, so statements that
+    // differ only in formatting share one cache slot.
+    static void Normalize(const char *sql, std::string &out){
+        out.clear();
+
+        char quote = 0;
+        bool pending_space = false;
+        for(const char *it = sql; *it; it++){
+            const char ch = *it;
+
+            if(quote){
+                out += ch;
+                if(ch == quote)
+                    quote = 0;
+                continue;
+            }
+
+            if(ch == '-' && it[1] == '-'){
+                while(it[1] && it[1] != '\n')
+                    it++;
+                pending_space = true;
+                continue;
+            }
+
+            if(ch == '/' && it[1] == '*'){
+                for(it += 2; *it && !(it[0] == '*' && it[1] == '/'); it++);
+                if(!*it)
+                    break;
+                it++;
+                pending_space = true;
+                continue;
+            }
+
+            if(isspace((unsigned char)ch)){
+                pending_space = true;
+                continue;
+            }
+
+            if(pending_space && out.size())
+                out += ' ';
+            pending_space = false;
+
+            if(ch == '\'' || ch == '"' || ch == '`')
+                quote = ch;
+            if(ch == '[')
+                quote = ']';
+
+            out += ch;
+        }
+
+        while(out.size() && (out.back() == ';' || out.back() == ' '))
+            out.pop_back();
+    }
+};
+
+// Text is bound without a copy, so it has to outlive the statement that uses it
+inline int BindParameter(sqlite3_stmt *stmt, int index, int value){
+    return sqlite3_bind_int(stmt, index, value);
+}
+
+inline int BindParameter(sqlite3_stmt *stmt, int index, sqlite3_int64 value){
+    return sqlite3_bind_int64(stmt, index, value);
+}
+
+inline int BindParameter(sqlite3_stmt *stmt, int index, double value){
+    return sqlite3_bind_double(stmt, index, value);
+}
+
+inline int BindParameter(sqlite3_stmt *stmt, int index, const char *value){
+    return sqlite3_bind_text(stmt, index, value, -1, SQLITE_STATIC);
+}
+
+inline int BindParameter(sqlite3_stmt *stmt, int index, std::string_view value){
+    return sqlite3_bind_text(stmt, index, value.data(), (int)value.size(), SQLITE_STATIC);
+}
+
+inline int BindParameter(sqlite3_stmt *stmt, int index, std::nullptr_t){
+    return sqlite3_bind_null(stmt, index);
+}
+
+template<typename ...ArgsType>
+int BindParameters(sqlite3_stmt *stmt, const ArgsType &...args){
+    if constexpr(sizeof...(args) == 0)
+        return SQLITE_OK;
+
+    int index = 0;
+    int status = SQLITE_OK;
+    ((status = status == SQLITE_OK ? BindParameter(stmt, ++index, args) : status), ...);
+    return status;
+}
+
+// Rows captured once from a cursor into one flat buffer. Copies share the buffer,
+// so a result can be logged, re-read or scanned many times without touching SQLite.
+class MaterializedResult{
+private:
+    struct Cell{
+        int Type = SQLITE_NULL;
+        uint32_t TextOffset = 0;
+        union{
+            sqlite3_int64 Int = 0;
+            double Real;
+        };
+    };
+
+    struct Rows{
+        std::vector<std::string> ColumnNames;
+        std::vector<Cell> Cells;
+        std::string Text;
+        size_t RowCount = 0;
+    };
+
+    std::shared_ptr<const Rows> m_Rows;
+public:
+    // Same getters as QueryResult, so row decoders work on both
+    class Row{
+    private:
+        const Rows *m_Rows;
+        const Cell *m_Cells;
+    public:
+        Row(const Rows *rows, size_t index):
+            m_Rows(rows),
+            m_Cells(rows->Cells.data() + index * rows->ColumnNames.size())
+        {}
+
+        int GetColumnType(size_t index)const{
+            return m_Cells[index].Type;
+        }
+
+        int GetColumnInt(size_t index)const{
+            return (int)GetColumnInt64(index);
+        }
+
+        sqlite3_int64 GetColumnInt64(size_t index)const{
+            const Cell &cell = m_Cells[index];
+            if(cell.Type == SQLITE_INTEGER)
+                return cell.Int;
+            if(cell.Type == SQLITE_FLOAT)
+                return (sqlite3_int64)cell.Real;
+            if(cell.Type == SQLITE_TEXT)
+                return strtoll(m_Rows->Text.data() + cell.TextOffset, nullptr, 10);
+            return 0;
+        }
+
+        const char *GetColumnString(size_t index)const{
+            const Cell &cell = m_Cells[index];
+            if(cell.Type == SQLITE_NULL)
+                return nullptr;
+            return m_Rows->Text.data() + cell.TextOffset;
+        }
+
+        float GetColumnFloat(size_t index)const{
+            return (float)GetColumnDouble(index);
+        }
+
+        double GetColumnDouble(size_t index)const{
+            const Cell &cell = m_Cells[index];
+            if(cell.Type == SQLITE_FLOAT)
+                return cell.Real;
+            if(cell.Type == SQLITE_INTEGER)
+                return (double)cell.Int;
+            if(cell.Type == SQLITE_TEXT)
+                return strtod(m_Rows->Text.data() + cell.TextOffset, nullptr);
+            return 0;
+        }
+    };
+
+    MaterializedResult():
+        m_Rows(std::make_shared<Rows>())
+    {}
+
+    size_t RowCount()const{
+        return m_Rows->RowCount;
+    }
+
+    size_t GetColumnCount()const{
+        return m_Rows->ColumnNames.size();
+    }
+
+    const char *GetColumnName(size_t index)const{
+        return m_Rows->ColumnNames[index].c_str();
+    }
+
+    Row RowAt(size_t index)const{
+        return {m_Rows.get(), index};
+    }
+private:
+    friend class QueryResult;
+
+    // Captures the current row and up to 'max_rows' in total, 'status' is the
+    // result of the last step, SQLITE_ROW when the statement was left on a row that didn't fit
+    static MaterializedResult Capture(sqlite3_stmt *stmt, int &status, size_t max_rows){
+        auto rows = std::make_shared<Rows>();
+        const int column_count = stmt ? sqlite3_column_count(stmt) : 0;
+
+        for(int i = 0; i < column_count; i++)
+            rows->ColumnNames.emplace_back(sqlite3_column_name(stmt, i));
+
+        // Every non-null cell keeps its text form with the terminating zero,
+        // so strings are handed out in place just like sqlite3_column_text does
+        for(; status == SQLITE_ROW && rows->RowCount < max_rows; status = sqlite3_step(stmt)){
+            for(int i = 0; i < column_count; i++){
+                Cell cell;
+                cell.Type = sqlite3_column_type(stmt, i);
+
+                if(cell.Type == SQLITE_INTEGER)
+                    cell.Int = sqlite3_column_int64(stmt, i);
+                if(cell.Type == SQLITE_FLOAT)
+                    cell.Real = sqlite3_column_double(stmt, i);
+
+                if(cell.Type != SQLITE_NULL){
+                    const char *text = (const char *)sqlite3_column_text(stmt, i);
+                    cell.TextOffset = (uint32_t)rows->Text.size();
+                    rows->Text.append(text, sqlite3_column_bytes(stmt, i));
+                    rows->Text.push_back(0);
+                }
+
+                rows->Cells.push_back(cell);
+            }
+            rows->RowCount++;
+        }
+
+        MaterializedResult result;
+        result.m_Rows = Move(rows);
+        return result;
     }
 };
 
 class QueryResult{
 private:
     sqlite3 *m_Database;
-    sqlite3_stmt *m_Query;
+    StatementCache &m_Cache;
+    sqlite3_stmt *m_Query = nullptr;
+    size_t m_Slot = StatementCache::TransientSlot;
     DatabaseLogger &m_Logger;
-    Stmt m_Statement;
+    QueryProfiler &m_Profiler;
+    StepTimer m_Timer;
     bool m_Status = false;
 private:
     friend class Database;
-    QueryResult(sqlite3 *db, const Stmt &stmt, DatabaseLogger &logger):
+    QueryResult(sqlite3 *db, StatementCache &cache, const char *sql, DatabaseLogger &logger, QueryProfiler &profiler):
         m_Database(db),
-        m_Statement(stmt),
-        m_Logger(logger)
+        m_Cache(cache),
+        m_Logger(logger),
+        m_Profiler(profiler)
     {
-        if(sqlite3_prepare_v2(m_Database, stmt, -1, &m_Query, nullptr) != SQLITE_OK){
+        m_Query = m_Cache.Acquire(sql, m_Slot);
+        if(!m_Query && sqlite3_errcode(m_Database) != SQLITE_OK)
              m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Database));
-        }else {
-            Reset();
-        }
     }
 public:
-    QueryResult(const QueryResult &other):
-            QueryResult(other.m_Database, other.m_Statement, other.m_Logger)
-    {}
+    QueryResult(const QueryResult &other) = delete;
+
+    QueryResult(QueryResult &&other):
+            m_Database(other.m_Database),
+            m_Cache(other.m_Cache),
+            m_Query(other.m_Query),
+            m_Slot(other.m_Slot),
+            m_Logger(other.m_Logger),
+            m_Profiler(other.m_Profiler),
+            m_Timer(other.m_Timer),
+            m_Status(other.m_Status)
+    {
+        other.m_Query = nullptr;
+        other.m_Status = false;
+    }
 
     ~QueryResult(){
-        sqlite3_finalize(m_Query);
+        if(!m_Query)
+            return;
+        m_Timer.Finish(m_Query, m_Profiler);
+        m_Cache.Release(m_Query, m_Slot);
     }
-    QueryResult &operator=(const QueryResult &other){
-        this->~QueryResult();
-        new (this) QueryResult(other);
+
+    QueryResult &operator=(const QueryResult &other) = delete;
+
+    QueryResult &operator=(QueryResult &&other){
+        if(this != &other){
+            this->~QueryResult();
+            new (this) QueryResult(Move(other));
+        }
         return *this;
     }
 
     void Next(){
-        m_Status = sqlite3_step(m_Query) == SQLITE_ROW;
+        m_Status = m_Query && Check(m_Timer.Step(m_Query)) == SQLITE_ROW;
     }
 
     void Reset(){
+        m_Timer.Finish(m_Query, m_Profiler);
         sqlite3_reset(m_Query);
         Next();
     }
@@ -87,6 +605,10 @@ public:
         return sqlite3_column_int(m_Query, index);
     }
 
+    sqlite3_int64 GetColumnInt64(size_t index)const{
+        return sqlite3_column_int64(m_Query, index);
+    }
+
     const char *GetColumnString(size_t index)const{
         return (const char*)sqlite3_column_text(m_Query, index);
     }
@@ -106,46 +628,340 @@ public:
     size_t GetColumnCount()const{
         return sqlite3_column_count(m_Query);
     }
+
+    MaterializedResult Materialize(){
+        return Materialize(size_t(-1));
+    }
+
+    // Captures at most 'max_rows' rows, the cursor stays on the next one
+    MaterializedResult Materialize(size_t max_rows){
+        const auto begin = QueryProfiler::Clock::now();
+        int status = m_Status ? SQLITE_ROW : SQLITE_DONE;
+        MaterializedResult result = MaterializedResult::Capture(m_Query, status, max_rows);
+        const bool has_row = Check(status) == SQLITE_ROW;
+        // The current row was counted when it was stepped to
+        if(m_Query)
+            m_Timer.Count(QueryProfiler::Clock::now() - begin, result.RowCount() - m_Status + has_row);
+        m_Status = has_row;
+        return result;
+    }
+private:
+    int Check(int status){
+        if(status != SQLITE_ROW && status != SQLITE_DONE)
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Database));
+        return status;
+    }
+};
+
+// Rows of a result that come in a page at a time, every page but the last
+// holds the same number of rows
+class PagedResult{
+public:
+    static constexpr size_t DefaultPageSize = 256;
+private:
+    std::vector<MaterializedResult> m_Pages;
+    size_t m_RowCount = 0;
+    bool m_IsComplete = false;
+public:
+    PagedResult(MaterializedResult first_page, bool is_complete){
+        Append(Move(first_page), is_complete);
+    }
+
+    void Append(MaterializedResult page, bool is_last){
+        m_RowCount += page.RowCount();
+        m_Pages.push_back(Move(page));
+        m_IsComplete = is_last;
+    }
+
+    bool IsComplete()const{
+        return m_IsComplete;
+    }
+
+    // Rows that came in so far
+    size_t RowCount()const{
+        return m_RowCount;
+    }
+
+    size_t GetColumnCount()const{
+        return m_Pages.front().GetColumnCount();
+    }
+
+    const char *GetColumnName(size_t index)const{
+        return m_Pages.front().GetColumnName(index);
+    }
+
+    MaterializedResult::Row RowAt(size_t index)const{
+        const size_t page_size = m_Pages.front().RowCount();
+        return m_Pages[index / page_size].RowAt(index % page_size);
+    }
 };
 
-void DatabaseLogger::Log(const class QueryResult &query){
-    auto result = query;
-    Log("[QueryResult]:");
-    for(; result; result.Next()) {
-        std::stringstream string;
-        for(int i = 0;; i++){
-            string << result.GetColumnString(i);
+// Row counts of tables seen so far, kept current from the update hook.
+// Changes the hook can't see (the truncate optimization of a bare DELETE,
+// WITHOUT ROWID tables) show up as a mismatch against sqlite3_total_changes(),
+// rolled back changes are reported by the rollback hook, both drop the counts
+// so they are recounted on the next request.
+class RowCounts{
+private:
+    struct Entry{
+        std::string Table;
+        sqlite3_int64 Count = 0;
+    };
+
+    std::vector<Entry> m_Entries;
+    int m_ObservedChanges = 0;
+public:
+    void OnRowChange(int operation, const char *table){
+        m_ObservedChanges++;
+
+        Entry *entry = Find(table);
+        if(!entry)
+            return;
+
+        if(operation == SQLITE_INSERT)
+            entry->Count++;
+        if(operation == SQLITE_DELETE)
+            entry->Count--;
+    }
+
+    void Invalidate(int total_changes){
+        m_Entries.clear();
+        m_ObservedChanges = total_changes;
+    }
 
-            if (i == result.GetColumnCount() - 1)break;
+    bool IsInSync(int total_changes)const{
+        return m_ObservedChanges == total_changes;
+    }
 
-            string << std::setw(20);
+    bool TryGet(const char *table, sqlite3_int64 &count){
+        Entry *entry = Find(table);
+        if(entry)
+            count = entry->Count;
+        return entry;
+    }
+
+    void Store(const char *table, sqlite3_int64 count){
+        m_Entries.push_back({table, count});
+    }
+private:
+    Entry *Find(const char *table){
+        for(Entry &entry: m_Entries){
+            if(IsSameName(entry.Table.c_str(), table))
+                return &entry;
         }
-        Log(string.str().c_str());
+        return nullptr;
     }
-}
 
+    static bool IsSameName(const char *left, const char *right){
+        for(; *left && *right; left++, right++){
+            if(tolower((unsigned char)*left) != tolower((unsigned char)*right))
+                return false;
+        }
+        return *left == *right;
+    }
+};
+
+// Storage settings of a connection, the defaults are SQLite's own
+struct StorageProfile{
+    enum class TempStorage{
+        Default = 0,
+        File = 1,
+        Memory = 2
+    };
+    // Bytes of the file read through a memory map instead of read() calls, 0 disables it
+    sqlite3_int64 MmapSize = 0;
+    // Page cache budget per connection
+    int CacheSizeKiB = 2000;
+    // Power of two from 512 to 65536. A file keeps its page size until it
+    // is rewritten, the new one is picked up by VacuumInto()
+    int PageSize = 4096;
+    TempStorage TempStore = TempStorage::Default;
+
+    static StorageProfile Defaults(){
+        return {};
+    }
+
+    // Whole database mapped and cached, temporary b-trees for sorts kept in memory
+    static StorageProfile ReadHeavy(){
+        StorageProfile profile;
+        profile.MmapSize = 256 * 1024 * 1024;
+        profile.CacheSizeKiB = 64 * 1024;
+        profile.TempStore = TempStorage::Memory;
+        return profile;
+    }
+};
+
+// One step of the schema history. Applied in order of Version, each in its own
+// transaction, and recorded in PRAGMA user_version once it committed
+struct Migration{
+    int Version;
+    const char *Description;
+    const char *Sql;
+};
+
+enum class Durability{
+    // Every commit is synced before it returns
+    Full,
+    // The WAL is synced on checkpoints, a power loss may drop the last commits but never corrupts
+    Normal,
+    // Syncing is left to the OS
+    Off
+};
+
+// A statement prepared once for a loop that runs it many times, executed
+// through Database::Execute without the statement cache lookup. It is not
+// profiled, and is finalized when it goes out of scope.
+class PreparedStatement{
+private:
+    sqlite3_stmt *m_Handle = nullptr;
+public:
+    PreparedStatement() = default;
+
+    PreparedStatement(PreparedStatement &&other):
+        m_Handle(other.m_Handle)
+    {
+        other.m_Handle = nullptr;
+    }
+
+    PreparedStatement &operator=(PreparedStatement &&other){
+        std::swap(m_Handle, other.m_Handle);
+        return *this;
+    }
+
+    PreparedStatement(const PreparedStatement &) = delete;
+
+    PreparedStatement &operator=(const PreparedStatement &) = delete;
+
+    ~PreparedStatement(){
+        sqlite3_finalize(m_Handle);
+    }
+
+    operator bool()const{
+        return m_Handle;
+    }
+
+    friend class Database;
+};
 
 class Database{
 private:
     sqlite3 *m_Handle = nullptr;
     DatabaseLogger &m_Logger;
+    StatementCache m_Cache;
+    RowCounts m_RowCounts;
+    ChangeStream m_Changes;
+    QueryProfiler m_Profiler;
+    sqlite3_int64 m_DataVersion = 0;
 
     using CallbackType = Function<void(int, char**, char**)>;
 public:
 
-    Database(const char *filepath, DatabaseLogger &logger):
-            m_Logger(logger)
+    static constexpr int BusyTimeoutMs = 5000;
+    // What SQLite starts every connection with
+    static constexpr int DefaultAutoCheckpointPages = 1000;
+    // A waiting writer checks the lock this often, so the short gaps bulk
+    // imports leave between their chunks are not missed
+    static constexpr int BusyPollMs = 1;
+
+    Database(const char *filepath, DatabaseLogger &logger, int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE):
+            m_Handle(Open(filepath, flags)),
+            m_Logger(logger),
+            m_Cache(m_Handle)
     {
-        sqlite3_open(filepath, &m_Handle);
+        if(!IsReadOnly())
+            EnableWriteAheadLog();
+
+        m_RowCounts.Invalidate(sqlite3_total_changes(m_Handle));
+        sqlite3_update_hook(m_Handle, &Database::OnUpdate, this);
+        sqlite3_commit_hook(m_Handle, &Database::OnCommit, this);
+        sqlite3_rollback_hook(m_Handle, &Database::OnRollback, this);
     }
 
+    Database(const Database &) = delete;
+
+    Database &operator=(const Database &) = delete;
+
     ~Database(){
+        m_Cache.Clear();
         sqlite3_close(m_Handle);
     }
 
+    template<typename ...ArgsType>
+    bool Execute(const char *sql, const ArgsType &...args){
+        size_t slot = 0;
+        bool is_complete = true;
+        sqlite3_stmt *handle = m_Cache.Acquire(sql, slot, &is_complete);
+        if(!handle && sqlite3_errcode(m_Handle) != SQLITE_OK){
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Handle));
+            return false;
+        }
+
+        if(!is_complete){
+            m_Cache.Release(handle, slot);
+            if(sizeof...(args)){
+                m_Logger.Log("[SQLite]: parameters can't be bound to multiple statements");
+                return false;
+            }
+            return ExecuteScript(sql);
+        }
+
+        // Blank statements prepare to nothing
+        if(!handle)
+            return true;
+
+        StepTimer timer;
+        int status = BindParameters(handle, args...);
+        if(status == SQLITE_OK){
+            status = SQLITE_ROW;
+            while(status == SQLITE_ROW)
+                status = timer.Step(handle);
+        }
+
+        if(status != SQLITE_DONE)
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Handle));
+
+        timer.Finish(handle, m_Profiler);
+        m_Cache.Release(handle, slot);
+        PublishChanges();
+        return status == SQLITE_DONE;
+    }
+
     bool Execute(const Stmt &stmt){
+        return Execute<>(stmt);
+    }
+
+    // Logs and hands out an empty statement if 'sql' doesn't hold exactly one
+    PreparedStatement Prepare(const char *sql){
+        PreparedStatement stmt;
+        const char *tail = nullptr;
+        if(sqlite3_prepare_v3(m_Handle, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt.m_Handle, &tail) != SQLITE_OK)
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Handle));
+        else if(!stmt || *tail)
+            m_Logger.Log("[SQLite]: '%' is not a single statement", sql);
+        else
+            return stmt;
+        return {};
+    }
+
+    template<typename ...ArgsType>
+    bool Execute(PreparedStatement &stmt, const ArgsType &...args){
+        int status = BindParameters(stmt.m_Handle, args...);
+        while(status == SQLITE_OK || status == SQLITE_ROW)
+            status = sqlite3_step(stmt.m_Handle);
+
+        if(status != SQLITE_DONE)
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Handle));
+
+        sqlite3_reset(stmt.m_Handle);
+        PublishChanges();
+        return status == SQLITE_DONE;
+    }
+
+    bool Execute(const Stmt &stmt, int (*callback)(void *usr, int, char **, char **), void *usr){
         char *message = nullptr;
-        if(sqlite3_exec(m_Handle, stmt, nullptr, nullptr, &message) != SQLITE_OK){
+        const int status = sqlite3_exec(m_Handle, stmt, callback, usr, &message);
+        PublishChanges();
+        if(status != SQLITE_OK){
             m_Logger.Log("[SQLite]: %", message);
             sqlite3_free(message);
             return false;
@@ -154,9 +970,290 @@ public:
         return true;
     }
 
-    bool Execute(const Stmt &stmt, int (*callback)(void *usr, int, char **, char **), void *usr){
+    template<typename ...ArgsType>
+    QueryResult Query(const char *sql, const ArgsType &...args){
+        QueryResult result(m_Handle, m_Cache, sql, m_Logger, m_Profiler);
+        if(result.m_Query && BindParameters(result.m_Query, args...) != SQLITE_OK){
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Handle));
+            return result;
+        }
+        result.Reset();
+        PublishChanges();
+        return result;
+    }
+
+    QueryResult Query(const Stmt &stmt){
+        return Query<>(stmt);
+    }
+
+    // Safe to call from any thread, aborts whatever this connection is running
+    void Interrupt(){
+        sqlite3_interrupt(m_Handle);
+    }
+
+    // 'handler' is called every 'period' virtual machine instructions, a non zero return aborts the statement
+    void SetProgressHandler(int period, int (*handler)(void *), void *user){
+        sqlite3_progress_handler(m_Handle, period, handler, user);
+    }
+
+    // Rows changed by this connection since it was opened
+    int TotalChanges()const{
+        return sqlite3_total_changes(m_Handle);
+    }
+
+    // Committed row changes of this connection, see ChangeStream
+    std::shared_ptr<ChangeSubscription> SubscribeChanges(size_t capacity = ChangeStream::DefaultCapacity){
+        return m_Changes.Subscribe(capacity);
+    }
+
+    // Rows undone by ROLLBACK TO are reported by no hook
+    void OnSavepointRollback(){
+        m_RowCounts.Invalidate(sqlite3_total_changes(m_Handle));
+    }
+
+    // Commits of other connections are seen by no hook, call once in a while to
+    // drop what was derived from this connection's own changes. True if there were any
+    bool SyncExternalChanges(){
+        auto query = Query("PRAGMA data_version");
+        if(!query)
+            return false;
+
+        const sqlite3_int64 data_version = query.GetColumnInt64(0);
+        if(data_version == m_DataVersion)
+            return false;
+
+        const bool is_first = m_DataVersion == 0;
+        m_DataVersion = data_version;
+        if(is_first)
+            return false;
+
+        m_RowCounts.Invalidate(sqlite3_total_changes(m_Handle));
+        m_Changes.Invalidate();
+        return true;
+    }
+
+    const char *FilePath()const{
+        return sqlite3_db_filename(m_Handle, "main");
+    }
+
+    bool IsInTransaction()const{
+        return sqlite3_get_autocommit(m_Handle) == 0;
+    }
+
+    // Row id the latest successful INSERT of this connection was given
+    sqlite3_int64 LastInsertID()const{
+        return sqlite3_last_insert_rowid(m_Handle);
+    }
+
+    // Claims 'count' consecutive ids of an AUTOINCREMENT table and returns the
+    // first one, or -1. The engine never assigns ids from a claimed block, so
+    // rows may be inserted with them later in any order and from any batch
+    sqlite3_int64 ReserveIDs(const char *table, sqlite3_int64 count){
+        const bool is_own_transaction = !IsInTransaction();
+        if(is_own_transaction && !Execute("BEGIN IMMEDIATE"))
+            return -1;
+
+        sqlite3_int64 first = -1;
+        // Tables get their sqlite_sequence row with the first insert
+        const bool is_reserved =
+            Execute("INSERT INTO sqlite_sequence(name, seq) SELECT ?, 0 WHERE NOT EXISTS (SELECT 1 FROM sqlite_sequence WHERE name = ?)", table, table)
+            && Execute("UPDATE sqlite_sequence SET seq = seq + ? WHERE name = ?", count, table);
+        if(is_reserved){
+            auto query = Query("SELECT seq FROM sqlite_sequence WHERE name = ?", table);
+            if(query)
+                first = query.GetColumnInt64(0) - count + 1;
+        }
+
+        if(is_own_transaction && !Execute(first == -1 ? "ROLLBACK" : "COMMIT"))
+            return -1;
+        return first;
+    }
+
+    bool SetDurability(Durability durability){
+        switch(durability){
+        case Durability::Full:   return Execute("PRAGMA synchronous = FULL");
+        case Durability::Normal: return Execute("PRAGMA synchronous = NORMAL");
+        case Durability::Off:    return Execute("PRAGMA synchronous = OFF");
+        }
+        return false;
+    }
+
+    bool Configure(const StorageProfile &profile){
+        return Execute({"PRAGMA mmap_size = %", profile.MmapSize})
+            && Execute({"PRAGMA cache_size = -%", profile.CacheSizeKiB})
+            && Execute({"PRAGMA temp_store = %", (int)profile.TempStore})
+            && Execute({"PRAGMA page_size = %", profile.PageSize});
+    }
+
+    int PageSize(){
+        auto query = Query("PRAGMA page_size");
+        return query ? query.GetColumnInt(0) : 0;
+    }
+
+    // Writes a defragmented copy of the database, laid out with the configured page size
+    bool VacuumInto(const char *filepath){
+        return Execute("VACUUM INTO ?", filepath);
+    }
+
+    // Copies the database into 'filepath' at most 'pages_per_step' pages at a time,
+    // asking 'on_step(remaining, total)' whether to go on after each step. The
+    // source is read in one transaction, so on a connection of its own in WAL mode
+    // the copy never blocks writers and their commits never make it start over
+    template<typename StepCallbackType>
+    bool BackupTo(const char *filepath, int pages_per_step, StepCallbackType on_step){
+        sqlite3 *destination = nullptr;
+        if(sqlite3_open_v2(filepath, &destination, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK){
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(destination));
+            sqlite3_close(destination);
+            return false;
+        }
+
+        const bool is_snapshot = Execute("BEGIN");
+        if(is_snapshot)
+            Execute("SELECT 1 FROM sqlite_master LIMIT 1");
+
+        sqlite3_backup *backup = sqlite3_backup_init(destination, "main", m_Handle, "main");
+        int status = backup ? SQLITE_OK : sqlite3_errcode(destination);
+        while(status == SQLITE_OK || status == SQLITE_BUSY || status == SQLITE_LOCKED){
+            status = sqlite3_backup_step(backup, pages_per_step);
+            const bool is_continued = on_step(sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup));
+            if(status == SQLITE_DONE || !is_continued)
+                break;
+        }
+
+        if(status != SQLITE_DONE && status != SQLITE_OK)
+            m_Logger.Log("[SQLite]: %", sqlite3_errstr(status));
+
+        sqlite3_backup_finish(backup);
+        sqlite3_close(destination);
+        if(is_snapshot)
+            Execute("COMMIT");
+        return status == SQLITE_DONE;
+    }
+
+    int UserVersion(){
+        auto query = Query("PRAGMA user_version");
+        return query ? query.GetColumnInt(0) : 0;
+    }
+
+    // Applies the migrations newer than the database, stops at the first one that fails
+    template<size_t Count>
+    bool Migrate(const Migration (&migrations)[Count]){
+        int version = UserVersion();
+
+        for(const Migration &migration: migrations){
+            if(migration.Version <= version)
+                continue;
+
+            if(!Execute("BEGIN IMMEDIATE"))
+                return false;
+
+            if(!ExecuteScript(migration.Sql) || !Execute({"PRAGMA user_version = %", migration.Version})){
+                m_Logger.Log("[SQLite]: migration % (%) failed", migration.Version, migration.Description);
+                Execute("ROLLBACK");
+                return false;
+            }
+
+            if(!Execute("COMMIT")){
+                Execute("ROLLBACK");
+                return false;
+            }
+            version = migration.Version;
+        }
+        return true;
+    }
+
+    std::string ExplainQueryPlan(const char *sql){
+        return ::ExplainQueryPlan(m_Handle, sql);
+    }
+
+    bool IsReadOnly()const{
+        return sqlite3_db_readonly(m_Handle, "main") == 1;
+    }
+
+    // A commit that leaves the WAL longer than 'pages' checkpoints it before
+    // returning, zero leaves checkpoints to whoever calls Checkpoint()
+    void SetAutoCheckpoint(int pages){
+        sqlite3_wal_autocheckpoint(m_Handle, pages);
+    }
+
+    // Copies committed WAL frames back into the database file without taking
+    // the write lock, frames still needed by open readers are left for later
+    bool Checkpoint(int *wal_frames = nullptr, int *checkpointed_frames = nullptr){
+        if(sqlite3_wal_checkpoint_v2(m_Handle, nullptr, SQLITE_CHECKPOINT_PASSIVE, wal_frames, checkpointed_frames) != SQLITE_OK){
+            m_Logger.Log("[SQLite]: %", sqlite3_errmsg(m_Handle));
+            return false;
+        }
+        return true;
+    }
+
+    QueryProfiler &Profiler(){
+        return m_Profiler;
+    }
+
+    const StatementCache::Stats &CacheStats()const{
+        return m_Cache.GetStats();
+    }
+
+    void ResetCacheStats(){
+        m_Cache.ResetStats();
+    }
+
+    size_t Size(const char *table_name){
+        // Read-only connections never see their own changes, only other
+        // connections' commits, so their counts can't be kept by the hooks
+        if(IsReadOnly()){
+            auto query = Query({"SELECT COUNT(*) FROM %", table_name});
+            return query ? query.GetColumnInt64(0) : 0;
+        }
+
+        const int total_changes = sqlite3_total_changes(m_Handle);
+        if(!m_RowCounts.IsInSync(total_changes))
+            m_RowCounts.Invalidate(total_changes);
+
+        sqlite3_int64 count = 0;
+        if(m_RowCounts.TryGet(table_name, count))
+            return count;
+
+        auto query = Query({"SELECT COUNT(*) FROM %", table_name});
+        if(!query)
+            return 0;
+
+        count = query.GetColumnInt64(0);
+        m_RowCounts.Store(table_name, count);
+        return count;
+    }
+private:
+    static void OnUpdate(void *user, int operation, const char *database, const char *table, sqlite3_int64 rowid){
+        auto *self = (Database *)user;
+        const bool is_main = strcmp(database, "main") == 0;
+        self->m_RowCounts.OnRowChange(operation, is_main ? table : "");
+        if(is_main)
+            self->m_Changes.OnRowChange(operation, table, rowid);
+    }
+
+    static int OnCommit(void *user){
+        auto *self = (Database *)user;
+        self->m_Changes.OnCommit();
+        return 0;
+    }
+
+    static void OnRollback(void *user){
+        auto *self = (Database *)user;
+        self->m_RowCounts.Invalidate(sqlite3_total_changes(self->m_Handle));
+        self->m_Changes.OnRollback();
+    }
+
+    void PublishChanges(){
+        if(!IsInTransaction())
+            m_Changes.Publish();
+    }
+
+    bool ExecuteScript(const char *sql){
         char *message = nullptr;
-        if(sqlite3_exec(m_Handle, stmt, callback, usr, &message) != SQLITE_OK){
+        const int status = sqlite3_exec(m_Handle, sql, nullptr, nullptr, &message);
+        PublishChanges();
+        if(status != SQLITE_OK){
             m_Logger.Log("[SQLite]: %", message);
             sqlite3_free(message);
             return false;
@@ -165,17 +1262,25 @@ public:
         return true;
     }
 
-    QueryResult Query(const Stmt &stmt){
-        return {m_Handle, stmt, m_Logger};
+    // Readers no longer block the writer and the writer no longer blocks readers
+    void EnableWriteAheadLog(){
+        Execute("PRAGMA journal_mode = WAL");
+        SetDurability(Durability::Normal);
     }
 
-    size_t Size(const char *table_name){
-        auto query = Query({"SELECT * FROM %", table_name});
-        size_t counter = 0;
-
-        for(;query; query.Next())
-            counter++;
+    static sqlite3 *Open(const char *filepath, int flags){
+        sqlite3 *handle = nullptr;
+        sqlite3_open_v2(filepath, &handle, flags, nullptr);
+        // Other connections may hold the file, wait for them instead of failing
+        sqlite3_busy_handler(handle, &Database::OnBusy, nullptr);
+        return handle;
+    }
 
-        return counter;
+    // The stock busy timeout backs off to 100 ms between attempts
+    static int OnBusy(void *, int attempts){
+        if(attempts >= BusyTimeoutMs / BusyPollMs)
+            return 0;
+        sqlite3_sleep(BusyPollMs);
+        return 1;
     }
 };
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+
+// Runs read queries on a pool of read-only connections, so the frame that
+// asks for data never waits for SQLite. With the database in WAL mode each
+// reader works on its own snapshot, in parallel with the others and with the
+// writer. Jobs are picked in submission order and their rows come back
+// materialized, ready to be shared with the render thread.
+class QueryExecutor{
+public:
+    using JobType = std::function<MaterializedResult(Database &)>;
+private:
+    struct Job{
+        JobType Function;
+        MaterializedResult Result;
+        std::string Error;
+        std::atomic<bool> IsDone{false};
+    };
+public:
+    class Future{
+    private:
+        std::shared_ptr<Job> m_Job;
+    public:
+        Future() = default;
+
+        Future(std::shared_ptr<Job> job):
+            m_Job(Move(job))
+        {}
+
+        bool IsValid()const{
+            return (bool)m_Job;
+        }
+
+        bool IsReady()const{
+            return m_Job && m_Job->IsDone.load(std::memory_order_acquire);
+        }
+
+        // Only valid once IsReady() returned true
+        const MaterializedResult &Result()const{
+            return m_Job->Result;
+        }
+
+        const std::string &Error()const{
+            return m_Job->Error;
+        }
+    };
+private:
+    struct Reader{
+        DatabaseLogger Logger;
+        Database Connection;
+        std::thread Thread;
+
+        Reader(const char *filepath):
+            Connection(filepath, Logger, SQLITE_OPEN_READONLY)
+        {}
+    };
+
+    std::mutex m_QueueLock;
+    std::condition_variable m_QueueSignal;
+    std::deque<std::shared_ptr<Job>> m_Queue;
+    bool m_IsRunning = true;
+
+    std::vector<std::unique_ptr<Reader>> m_Readers;
+public:
+    static size_t DefaultReadersCount(){
+        const size_t cores = std::thread::hardware_concurrency();
+        // Leave a core for the render thread and one for the writer
+        return cores > 3 ? std::min<size_t>(cores - 2, 4) : 1;
+    }
+
+    QueryExecutor(const char *filepath, size_t readers_count = DefaultReadersCount()){
+        for(size_t i = 0; i < readers_count; i++)
+            m_Readers.push_back(std::make_unique<Reader>(filepath));
+        // Threads are started only once every connection is open
+        for(auto &reader: m_Readers)
+            reader->Thread = std::thread(&QueryExecutor::WorkerMain, this, reader.get());
+    }
+
+    QueryExecutor(const QueryExecutor &) = delete;
+
+    QueryExecutor &operator=(const QueryExecutor &) = delete;
+
+    ~QueryExecutor(){
+        {
+            std::lock_guard<std::mutex> lock(m_QueueLock);
+            m_IsRunning = false;
+            m_Queue.clear();
+        }
+        for(auto &reader: m_Readers)
+            reader->Connection.Interrupt();
+        m_QueueSignal.notify_all();
+        for(auto &reader: m_Readers)
+            reader->Thread.join();
+    }
+
+    size_t ReadersCount()const{
+        return m_Readers.size();
+    }
+
+    Future Submit(JobType function){
+        auto job = std::make_shared<Job>();
+        job->Function = Move(function);
+        {
+            std::lock_guard<std::mutex> lock(m_QueueLock);
+            m_Queue.push_back(job);
+        }
+        m_QueueSignal.notify_one();
+        return {job};
+    }
+private:
+    void WorkerMain(Reader *reader){
+        for(;;){
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(m_QueueLock);
+                m_QueueSignal.wait(lock, [this](){ return !m_IsRunning || m_Queue.size(); });
+                if(!m_IsRunning)
+                    return;
+                job = Move(m_Queue.front());
+                m_Queue.pop_front();
+            }
+
+            reader->Logger.Clear();
+            job->Result = job->Function(reader->Connection);
+            if(reader->Logger.Size())
+                job->Error = reader->Logger.Last();
+            job->IsDone.store(true, std::memory_order_release);
+        }
+    }
+};
+
+// Moves the WAL back into the database file off the writer's thread. The
+// checkpoints are passive, so they never wait on the write lock and the
+// writer never waits on them; they only copy frames no reader still needs.
+// The writer's automatic checkpoints, which run inside the commit that crosses
+// the threshold, are turned off for as long as the checkpointer lives.
+// Failed checkpoints are reported to the logger it is given.
+class WalCheckpointer{
+public:
+    static constexpr auto DefaultPeriod = std::chrono::milliseconds(500);
+private:
+    Database &m_Writer;
+    Database m_Database;
+    std::chrono::steady_clock::duration m_Period;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Signal;
+    bool m_IsRunning = true;
+
+    std::thread m_Worker;
+public:
+    WalCheckpointer(Database &writer, DatabaseLogger &logger, std::chrono::steady_clock::duration period = DefaultPeriod):
+        m_Writer(writer),
+        m_Database(writer.FilePath(), logger, SQLITE_OPEN_READWRITE),
+        m_Period(period),
+        m_Worker(&WalCheckpointer::WorkerMain, this)
+    {
+        m_Writer.SetAutoCheckpoint(0);
+    }
+
+    WalCheckpointer(const WalCheckpointer &) = delete;
+
+    WalCheckpointer &operator=(const WalCheckpointer &) = delete;
+
+    ~WalCheckpointer(){
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_IsRunning = false;
+        }
+        m_Signal.notify_one();
+        m_Worker.join();
+
+        m_Writer.SetAutoCheckpoint(Database::DefaultAutoCheckpointPages);
+    }
+private:
+    void WorkerMain(){
+        std::unique_lock<std::mutex> lock(m_Lock);
+        while(!m_Signal.wait_for(lock, m_Period, [this](){ return !m_IsRunning; })){
+            lock.unlock();
+            m_Database.Checkpoint();
+            lock.lock();
+        }
+    }
+};
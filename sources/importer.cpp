@@ -0,0 +1,714 @@
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// Read-only view of a whole file. Pages are brought in by the OS as they are
+// touched and can be dropped again, so the resident size stays bounded
+// whatever the size of the file
+class MappedFile{
+private:
+    const char *m_Data = nullptr;
+    size_t m_Size = 0;
+#ifdef _WIN32
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = nullptr;
+#endif
+public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile(){
+        Close();
+    }
+
+    bool Open(const char *filepath){
+        Close();
+#ifdef _WIN32
+        m_File = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(m_File == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(m_File, &size))
+            return false;
+        m_Size = (size_t)size.QuadPart;
+        if(!m_Size)
+            return true;
+
+        m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!m_Mapping)
+            return false;
+        m_Data = (const char *)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+        return m_Data;
+#else
+        const int file = open(filepath, O_RDONLY);
+        if(file < 0)
+            return false;
+
+        struct stat info;
+        if(fstat(file, &info) != 0){
+            close(file);
+            return false;
+        }
+        m_Size = info.st_size;
+
+        void *data = m_Size ? mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0) : nullptr;
+        close(file);
+        if(data == MAP_FAILED)
+            return false;
+
+        m_Data = (const char *)data;
+        if(m_Data)
+            madvise(data, m_Size, MADV_SEQUENTIAL);
+        return true;
+#endif
+    }
+
+    void Close(){
+#ifdef _WIN32
+        if(m_Data)
+            UnmapViewOfFile(m_Data);
+        if(m_Mapping)
+            CloseHandle(m_Mapping);
+        if(m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+        m_Mapping = nullptr;
+        m_File = INVALID_HANDLE_VALUE;
+#else
+        if(m_Data)
+            munmap((void *)m_Data, m_Size);
+#endif
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+
+    const char *Data()const{
+        return m_Data;
+    }
+
+    size_t Size()const{
+        return m_Size;
+    }
+};
+
+struct ImportValue{
+    enum TypeKind{
+        Null,
+        Integer,
+        Real,
+        Text
+    };
+    TypeKind Type = Null;
+    sqlite3_int64 IntegerValue = 0;
+    double RealValue = 0;
+    // Points into the input or into the reader's scratch storage
+    std::string_view TextValue;
+};
+
+using ImportRow = std::vector<ImportValue>;
+
+// A whole row goes into consecutive parameters starting at 'index'
+inline int BindParameter(sqlite3_stmt *stmt, int index, const ImportRow &row){
+    int status = SQLITE_OK;
+    for(size_t i = 0; i < row.size() && status == SQLITE_OK; i++){
+        const ImportValue &value = row[i];
+        switch(value.Type){
+        case ImportValue::Null:    status = BindParameter(stmt, index + i, nullptr); break;
+        case ImportValue::Integer: status = BindParameter(stmt, index + i, value.IntegerValue); break;
+        case ImportValue::Real:    status = BindParameter(stmt, index + i, value.RealValue); break;
+        case ImportValue::Text:    status = BindParameter(stmt, index + i, value.TextValue); break;
+        }
+    }
+    return status;
+}
+
+enum class ReadStatus{
+    Row,
+    End,
+    Error
+};
+
+// RFC 4180 text with a header line naming the columns. Unquoted fields that
+// are whole numbers are imported as numbers, empty unquoted fields as NULL,
+// everything else as text
+class CsvReader{
+private:
+    const char *m_It;
+    const char *m_End;
+    size_t m_Line = 1;
+    size_t m_RecordLine = 1;
+    std::string m_Error;
+    // One per column, so the unescaped text of a field outlives the next field.
+    // A deque never moves its strings when it grows
+    std::deque<std::string> m_Unescaped;
+public:
+    CsvReader(const char *begin, const char *end):
+        m_It(begin),
+        m_End(end)
+    {
+        // UTF-8 byte order mark
+        if(m_End - m_It >= 3 && memcmp(m_It, "\xEF\xBB\xBF", 3) == 0)
+            m_It += 3;
+    }
+
+    bool ReadHeader(std::vector<std::string> &columns){
+        SkipEmptyLines();
+
+        ImportRow header;
+        if(ReadRecord(header, false) != ReadStatus::Row)
+            return Fail("missing header");
+
+        for(const ImportValue &value: header)
+            columns.emplace_back(value.TextValue);
+        return true;
+    }
+
+    ReadStatus Next(ImportRow &row){
+        SkipEmptyLines();
+        return ReadRecord(row, true);
+    }
+
+    size_t Position(const char *begin)const{
+        return m_It - begin;
+    }
+
+    // Where the last record started
+    size_t Line()const{
+        return m_RecordLine;
+    }
+
+    const std::string &Error()const{
+        return m_Error;
+    }
+private:
+    ReadStatus ReadRecord(ImportRow &row, bool is_typed){
+        if(m_It == m_End)
+            return ReadStatus::End;
+
+        m_RecordLine = m_Line;
+        row.clear();
+        for(;;){
+            ImportValue &value = row.emplace_back();
+            if(!ReadField(value, row.size() - 1, is_typed))
+                return ReadStatus::Error;
+
+            if(m_It == m_End)
+                break;
+            if(*m_It == ','){
+                m_It++;
+                continue;
+            }
+            if(*m_It == '\r')
+                m_It++;
+            if(m_It != m_End && *m_It == '\n'){
+                m_It++;
+                m_Line++;
+                break;
+            }
+            Fail("unexpected character after a quoted field");
+            return ReadStatus::Error;
+        }
+        return ReadStatus::Row;
+    }
+
+    bool ReadField(ImportValue &value, size_t column, bool is_typed){
+        if(m_It != m_End && *m_It == '"')
+            return ReadQuotedField(value, column);
+
+        const char *begin = m_It;
+        while(m_It != m_End && *m_It != ',' && *m_It != '\n' && *m_It != '\r')
+            m_It++;
+
+        const std::string_view text(begin, m_It - begin);
+        if(!is_typed){
+            value = {ImportValue::Text, 0, 0, text};
+            return true;
+        }
+
+        if(text.empty())
+            value = {};
+        else if(ParseNumber(text, value.IntegerValue))
+            value.Type = ImportValue::Integer;
+        else if(ParseNumber(text, value.RealValue))
+            value.Type = ImportValue::Real;
+        else
+            value = {ImportValue::Text, 0, 0, text};
+        return true;
+    }
+
+    bool ReadQuotedField(ImportValue &value, size_t column){
+        const char *begin = ++m_It;
+        bool has_escapes = false;
+        for(;;){
+            if(m_It == m_End)
+                return Fail("unterminated quoted field");
+            if(*m_It == '\n')
+                m_Line++;
+            if(*m_It == '"'){
+                if(m_It + 1 != m_End && m_It[1] == '"'){
+                    has_escapes = true;
+                    m_It += 2;
+                    continue;
+                }
+                break;
+            }
+            m_It++;
+        }
+        std::string_view text(begin, m_It - begin);
+        m_It++;
+
+        if(has_escapes){
+            if(column >= m_Unescaped.size())
+                m_Unescaped.resize(column + 1);
+
+            std::string &unescaped = m_Unescaped[column];
+            unescaped.clear();
+            for(size_t i = 0; i < text.size(); i++){
+                unescaped.push_back(text[i]);
+                if(text[i] == '"')
+                    i++;
+            }
+            text = unescaped;
+        }
+        value = {ImportValue::Text, 0, 0, text};
+        return true;
+    }
+
+    void SkipEmptyLines(){
+        while(m_It != m_End && (*m_It == '\n' || *m_It == '\r')){
+            m_Line += *m_It == '\n';
+            m_It++;
+        }
+    }
+
+    // Infinities and NaN stay text, SQLite would store NaN as NULL
+    template<typename NumberType>
+    static bool ParseNumber(std::string_view text, NumberType &number){
+        const char *end = text.data() + text.size();
+        const char *begin = text.data() + (text[0] == '+');
+        // from_chars takes a minus but not a plus, one sign at most
+        if(begin != text.data() && (begin == end || *begin == '-'))
+            return false;
+
+        const auto result = std::from_chars(begin, end, number);
+        if(result.ec != std::errc() || result.ptr != end)
+            return false;
+        if constexpr(std::is_floating_point_v<NumberType>)
+            return std::isfinite(number);
+        return true;
+    }
+
+    bool Fail(const char *error){
+        m_Error = error;
+        return false;
+    }
+};
+
+// Compact binary input, little-endian:
+//   "BRWB", u8 version, u16 columns count, per column u8 name length and the name
+//   per row and column: u8 type, then i64 | f64 | u32 length and UTF-8 text
+class BinaryReader{
+public:
+    static constexpr char Magic[4] = {'B', 'R', 'W', 'B'};
+    static constexpr uint8_t Version = 1;
+private:
+    const char *m_It;
+    const char *m_End;
+    size_t m_Row = 0;
+    size_t m_ColumnsCount = 0;
+    std::string m_Error;
+public:
+    BinaryReader(const char *begin, const char *end):
+        m_It(begin),
+        m_End(end)
+    {}
+
+    static bool IsBinary(const char *begin, const char *end){
+        return end - begin >= (ptrdiff_t)sizeof(Magic) && memcmp(begin, Magic, sizeof(Magic)) == 0;
+    }
+
+    bool ReadHeader(std::vector<std::string> &columns){
+        m_It += sizeof(Magic);
+
+        uint8_t version = 0;
+        uint16_t columns_count = 0;
+        if(!Read(version) || version != Version || !Read(columns_count))
+            return Fail("unsupported header");
+
+        for(uint16_t i = 0; i < columns_count; i++){
+            uint8_t length = 0;
+            if(!Read(length) || m_End - m_It < length)
+                return Fail("truncated header");
+            columns.emplace_back(m_It, length);
+            m_It += length;
+        }
+        m_ColumnsCount = columns_count;
+        return true;
+    }
+
+    ReadStatus Next(ImportRow &row){
+        if(m_It == m_End)
+            return ReadStatus::End;
+
+        m_Row++;
+        row.resize(m_ColumnsCount);
+        for(ImportValue &value: row){
+            if(!ReadValue(value))
+                return ReadStatus::Error;
+        }
+        return ReadStatus::Row;
+    }
+
+    size_t Position(const char *begin)const{
+        return m_It - begin;
+    }
+
+    // Rows are counted from 1, the header is not a row
+    size_t Line()const{
+        return m_Row;
+    }
+
+    const std::string &Error()const{
+        return m_Error;
+    }
+private:
+    bool ReadValue(ImportValue &value){
+        uint8_t type = 0;
+        if(!Read(type))
+            return Fail("truncated row");
+
+        value.Type = (ImportValue::TypeKind)type;
+        switch(type){
+        case ImportValue::Null:
+            return true;
+        case ImportValue::Integer:
+            return Read(value.IntegerValue) || Fail("truncated integer");
+        case ImportValue::Real:
+            if(!Read(value.RealValue))
+                return Fail("truncated real");
+            return !std::isnan(value.RealValue) || Fail("real is NaN");
+        case ImportValue::Text:{
+            uint32_t length = 0;
+            if(!Read(length) || (size_t)(m_End - m_It) < length)
+                return Fail("truncated text");
+            value.TextValue = std::string_view(m_It, length);
+            m_It += length;
+            return true;
+        }
+        }
+        return Fail("unknown value type");
+    }
+
+    template<typename Type>
+    bool Read(Type &value){
+        if((size_t)(m_End - m_It) < sizeof(Type))
+            return false;
+        memcpy(&value, m_It, sizeof(Type));
+        m_It += sizeof(Type);
+        return true;
+    }
+
+    bool Fail(const char *error){
+        m_Error = error;
+        return false;
+    }
+};
+
+// Loads a CSV or binary file into one table on a connection and thread of its
+// own. Rows are committed in chunks that hold the write lock for ChunkPeriod
+// at most, so writers of other connections get their turn in between. A failed
+// import keeps the chunks committed before the failure. Indexes of the table
+// are dropped and built once at the end when the file is expected to outgrow
+// what the table already holds, they are built again whatever the outcome and
+// without being interrupted; SchemaMigrator rebuilds the lookup indexes an
+// import killed halfway left missing.
+class BulkImport{
+public:
+    enum class State{
+        Running,
+        Done,
+        Failed,
+        Cancelled
+    };
+
+    struct Progress{
+        uint64_t Rows = 0;
+        // Rows that stay in the table whatever the outcome
+        uint64_t CommittedRows = 0;
+        uint64_t Bytes = 0;
+        uint64_t TotalBytes = 0;
+    };
+
+    static constexpr uint64_t ProgressRows = 4096;
+    // The projection of how many rows the file holds is made after this many rows
+    static constexpr uint64_t DeferIndexesRows = 4 * ProgressRows;
+    static constexpr int CacheSizeKiB = 64 * 1024;
+    static constexpr auto ChunkPeriod = std::chrono::milliseconds(50);
+    // Long enough for a writer waiting on the lock to notice it is free
+    static constexpr auto ChunkPause = std::chrono::milliseconds(Database::BusyPollMs * 2);
+private:
+    struct IndexDefinition{
+        std::string Name;
+        std::string Sql;
+    };
+
+    std::string m_Table;
+    std::string m_FilePath;
+
+    DatabaseLogger m_Logger;
+    Database m_Database;
+
+    std::atomic<uint64_t> m_Rows{0};
+    std::atomic<uint64_t> m_CommittedRows{0};
+    std::atomic<uint64_t> m_Bytes{0};
+    std::atomic<uint64_t> m_TotalBytes{0};
+    std::atomic<State> m_State{State::Running};
+    std::atomic<bool> m_IsCancelled{false};
+    // Cleared once the rows are in, an interrupted index rebuild would leave the table without them
+    std::mutex m_InterruptLock;
+    bool m_IsInterruptible = true;
+
+    std::thread m_Worker;
+public:
+    BulkImport(const char *database_path, const char *table, const char *filepath):
+        m_Table(table),
+        m_FilePath(filepath),
+        m_Database(database_path, m_Logger, SQLITE_OPEN_READWRITE),
+        m_Worker(&BulkImport::WorkerMain, this)
+    {}
+
+    BulkImport(const BulkImport &) = delete;
+
+    BulkImport &operator=(const BulkImport &) = delete;
+
+    ~BulkImport(){
+        Cancel();
+        m_Worker.join();
+    }
+
+    void Cancel(){
+        m_IsCancelled = true;
+
+        std::lock_guard<std::mutex> lock(m_InterruptLock);
+        if(m_IsInterruptible)
+            m_Database.Interrupt();
+    }
+
+    State GetState()const{
+        return m_State.load(std::memory_order_acquire);
+    }
+
+    bool IsRunning()const{
+        return GetState() == State::Running;
+    }
+
+    Progress GetProgress()const{
+        return {m_Rows.load(std::memory_order_relaxed), m_CommittedRows.load(std::memory_order_relaxed), m_Bytes.load(std::memory_order_relaxed), m_TotalBytes.load(std::memory_order_relaxed)};
+    }
+
+    // Errors of the import, only to be pumped and read once it is no longer running
+    DatabaseLogger &Log(){
+        return m_Logger;
+    }
+
+    const std::string &Table()const{
+        return m_Table;
+    }
+private:
+    void WorkerMain(){
+        m_State.store(Import(), std::memory_order_release);
+    }
+
+    State Import(){
+        MappedFile file;
+        if(!file.Open(m_FilePath.c_str())){
+            m_Logger.Log("[Import]: can't open '%'", m_FilePath.c_str());
+            return State::Failed;
+        }
+        m_TotalBytes = file.Size();
+
+        m_Database.Execute({"PRAGMA cache_size = -%", CacheSizeKiB});
+
+        const char *begin = file.Data();
+        const char *end = begin + file.Size();
+        if(BinaryReader::IsBinary(begin, end)){
+            BinaryReader reader(begin, end);
+            return Import(reader, begin);
+        }
+        CsvReader reader(begin, end);
+        return Import(reader, begin);
+    }
+
+    template<typename ReaderType>
+    State Import(ReaderType &reader, const char *begin){
+        std::vector<std::string> columns;
+        if(!reader.ReadHeader(columns))
+            return Fail(reader, "%", reader.Error().c_str());
+
+        std::string sql;
+        if(!MakeInsert(columns, sql))
+            return State::Failed;
+        PreparedStatement insert = m_Database.Prepare(sql.c_str());
+        if(!insert)
+            return State::Failed;
+
+        const uint64_t existing_rows = m_Database.Size(m_Table.c_str());
+
+        std::vector<IndexDefinition> deferred;
+        const State state = ImportRows(reader, begin, insert, columns.size(), existing_rows, deferred);
+        {
+            std::lock_guard<std::mutex> lock(m_InterruptLock);
+            m_IsInterruptible = false;
+        }
+
+        if(!RestoreIndexes(deferred)){
+            m_Logger.Log("[Import]: indexes of % were not all rebuilt, the lookup ones are rebuilt on the next start", m_Table.c_str());
+            if(state == State::Done)
+                return State::Failed;
+        }
+        return state;
+    }
+
+    template<typename ReaderType>
+    State ImportRows(ReaderType &reader, const char *begin, PreparedStatement &insert, size_t columns_count, uint64_t existing_rows, std::vector<IndexDefinition> &deferred){
+        std::optional<Transaction> chunk;
+        chunk.emplace(m_Database);
+        if(!chunk->IsActive())
+            return State::Failed;
+        auto chunk_start = std::chrono::steady_clock::now();
+
+        ImportRow row;
+        uint64_t rows = 0;
+        for(;;){
+            const ReadStatus status = reader.Next(row);
+            if(status == ReadStatus::End)
+                break;
+            if(status == ReadStatus::Error)
+                return Fail(reader, "%", reader.Error().c_str());
+            if(row.size() != columns_count)
+                return Fail(reader, "% values for % columns", row.size(), columns_count);
+
+            if(!m_Database.Execute(insert, row))
+                return m_IsCancelled ? State::Cancelled : Fail(reader, "row was not inserted");
+
+            if(++rows % ProgressRows)
+                continue;
+
+            m_Rows.store(rows, std::memory_order_relaxed);
+            m_Bytes.store(reader.Position(begin), std::memory_order_relaxed);
+            if(m_IsCancelled)
+                return State::Cancelled;
+
+            if(rows == DeferIndexesRows){
+                const uint64_t expected_rows = rows * m_TotalBytes / reader.Position(begin);
+                if(expected_rows > existing_rows && !DropIndexes(deferred))
+                    return State::Failed;
+            }
+
+            if(std::chrono::steady_clock::now() - chunk_start < ChunkPeriod)
+                continue;
+
+            if(!chunk->Commit())
+                return State::Failed;
+            m_CommittedRows.store(rows, std::memory_order_relaxed);
+            std::this_thread::sleep_for(ChunkPause);
+
+            chunk.emplace(m_Database);
+            if(!chunk->IsActive())
+                return State::Failed;
+            chunk_start = std::chrono::steady_clock::now();
+        }
+
+        if(!chunk->Commit())
+            return State::Failed;
+        m_CommittedRows.store(rows, std::memory_order_relaxed);
+
+        m_Rows.store(rows, std::memory_order_relaxed);
+        m_Bytes.store(reader.Position(begin), std::memory_order_relaxed);
+        return State::Done;
+    }
+
+    bool MakeInsert(const std::vector<std::string> &columns, std::string &insert){
+        std::vector<std::string> known;
+        for(auto query = m_Database.Query("SELECT name FROM pragma_table_info(?)", m_Table.c_str()); query; query.Next())
+            known.emplace_back(query.GetColumnString(0));
+
+        if(known.empty()){
+            m_Logger.Log("[Import]: there is no table '%'", m_Table.c_str());
+            return false;
+        }
+
+        insert = "INSERT INTO \"" + m_Table + "\"(";
+        for(size_t i = 0; i < columns.size(); i++){
+            bool is_known = false;
+            for(const std::string &name: known)
+                is_known |= sqlite3_stricmp(name.c_str(), columns[i].c_str()) == 0;
+
+            if(!is_known){
+                m_Logger.Log("[Import]: table % has no column '%'", m_Table.c_str(), columns[i].c_str());
+                return false;
+            }
+            insert += (i ? ", \"" : "\"") + columns[i] + "\"";
+        }
+        insert += ") VALUES(";
+        for(size_t i = 0; i < columns.size(); i++)
+            insert += i ? ", ?" : "?";
+        insert += ")";
+        return true;
+    }
+
+    // Implicit indexes of PRIMARY KEY and UNIQUE have no sql and stay, they enforce constraints
+    bool DropIndexes(std::vector<IndexDefinition> &indexes){
+        for(auto query = m_Database.Query("SELECT name, sql FROM sqlite_master WHERE type = 'index' AND tbl_name = ? AND sql IS NOT NULL", m_Table.c_str()); query; query.Next())
+            indexes.push_back({query.GetColumnString(0), query.GetColumnString(1)});
+
+        for(const IndexDefinition &index: indexes){
+            if(!m_Database.Execute({"DROP INDEX \"%\"", index.Name.c_str()}))
+                return false;
+        }
+        return true;
+    }
+
+    // Indexes dropped in a chunk that was rolled back are still there
+    bool RestoreIndexes(const std::vector<IndexDefinition> &indexes){
+        bool is_restored = true;
+        for(const IndexDefinition &index: indexes){
+            if(m_Database.Query("SELECT 1 FROM sqlite_master WHERE type = 'index' AND name = ?", index.Name.c_str()))
+                continue;
+            is_restored &= m_Database.Execute(index.Sql.c_str());
+            std::this_thread::sleep_for(ChunkPause);
+        }
+        return is_restored;
+    }
+
+    template<typename ReaderType, typename ...ArgsType>
+    State Fail(const ReaderType &reader, const char *fmt, const ArgsType &...args){
+        m_Logger.Log("[Import]: %:%: %", m_FilePath.c_str(), reader.Line(), StringPrint(fmt, args...).Data());
+        return State::Failed;
+    }
+};
@@ -8,12 +8,37 @@
 #include <core/algorithm.hpp>
 #include <graphics/api/swapchain.hpp>
 #include <graphics/api/gpu.hpp>
-#include "implot.h"
 
-#include "windows.cpp"
+#include "workspace.cpp"
+#include "startup.cpp"
+#include <fstream>
+#include <future>
+#include <iterator>
 
 class Application{
 private:
+    static constexpr const char *DatabasePath = "brewery.sqlite";
+    static constexpr const char *FontPath = "Montserrat-Bold.ttf";
+
+    StartupTimeline m_Startup;
+
+    // The database opens and the font is read while the window and the GPU come up
+    RawVar<Workspace> m_Workspace;
+    std::thread m_WorkspaceLoader{[this](){
+        m_Startup.Measure("Open and migrate the database", [this](){
+            m_Workspace.Construct(DatabasePath);
+            m_Workspace->GetDatabase().Profiler().SlowLog().OpenFile("brewery_slow.log");
+            m_Workspace->GetLogger().SpillTo("brewery_console.log");
+        });
+    }};
+    std::future<std::vector<char>> m_FontFile{std::async(std::launch::async, [this](){
+        const auto begin = StartupTimeline::Clock::now();
+        std::ifstream file(FontPath, std::ios::binary);
+        std::vector<char> font{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        m_Startup.Add("Read the font", begin);
+        return font;
+    })};
+
     Window m_Window{1280, 720, "Brewery"};
     FramebufferChain m_Swapchain{&m_Window};
     ImGuiBackend m_Backend{m_Swapchain.Pass()};
@@ -26,26 +51,15 @@ private:
     float FramerateLimit = 60.f;
 
     Semaphore m_Begin, m_End;
-    DatabaseLogger m_Logger;
-    Database m_DB{"brewery.sqlite", m_Logger};
 
     RawVar<Dockspace> m_Dockspace;
 
-    ConsoleWindow m_ConsoleWindow{m_Logger, m_DB};
-    DrinksListPanel m_DrinksList{m_DB};
-    OrdersLogPanel m_OrdersLog{m_DB};
-    WaitersListPanel m_WaitersList{m_DB};
-    DrinksTransferProgressWindow m_DrinksTransfer;
-    SourcesListPanel m_SourcesList{m_DB, m_DrinksTransfer};
-    GobletsListPanel m_GobletsList{m_DB};
-
-
-    AnalyticsWindow m_Analytics{m_DB};
-
-    StoredProcedures m_Procedures{m_DB};
-
+    // Kept for the atlas, which does not own it
+    std::vector<char> m_Font;
 public:
     Application(){
+        m_Startup.Add("Create the window and the GPU context", m_Startup.Start());
+
         ImPlot::CreateContext();
         m_Window.SetEventsHandler({ this, &Application::OnEvent });
         
@@ -106,16 +120,34 @@ public:
 		colors[ImGuiCol_TitleBgActive] = ImVec4{ 0.15f, 0.1505f, 0.151f, 1.0f };
 		colors[ImGuiCol_TitleBgCollapsed] = ImVec4{ 0.15f, 0.1505f, 0.151f, 1.0f };
 
-        ImGuiIO& io = ImGui::GetIO();
-        io.Fonts->Clear();
-        io.Fonts->AddFontFromFileTTF(R"(Montserrat-Bold.ttf)", 18);
-        m_Backend.RebuildFonts();
+        m_Font = m_FontFile.get();
+        m_Startup.Measure("Build the font atlas", [this](){
+            ImFontConfig config;
+            config.FontDataOwnedByAtlas = false;
+
+            ImGuiIO& io = ImGui::GetIO();
+            io.Fonts->Clear();
+            if(m_Font.size())
+                io.Fonts->AddFontFromMemoryTTF(m_Font.data(), (int)m_Font.size(), 18, &config);
+            else
+                io.Fonts->AddFontDefault();
+            m_Backend.RebuildFonts();
+        });
+
+        const auto wait_begin = StartupTimeline::Clock::now();
+        m_WorkspaceLoader.join();
+        m_Startup.Add("Wait for the database", wait_begin);
+    }
+
+    ~Application(){
+        m_Workspace.Destruct();
     }
 
     void Run(){
         Clock cl;
         Fence fence;
         fence.Signal();
+        bool is_first_frame = true;
         for(;;){
             float dt = cl.GetElapsedTime().AsSeconds();
             cl.Restart();
@@ -126,8 +158,10 @@ public:
             if(!m_Window.IsOpen())
                 break;
         
+            const auto frame_begin = StartupTimeline::Clock::now();
             m_Backend.NewFrame(dt, Mouse::RelativePosition(m_Window), m_Window.Size());
             OnImGui();
+            m_Workspace->EndFrame();
 
             m_Swapchain.AcquireNext(&m_Begin);
             {
@@ -138,20 +172,23 @@ public:
                 GPU::Execute(m_CmdBuffer.Get(), m_Begin, m_End, fence);
             }
             m_Swapchain.PresentCurrent(&m_End);
+
+            if(is_first_frame)
+                m_Startup.Add("First frame", frame_begin);
+            is_first_frame = false;
+
+            // Panels shown at launch may still be loading in the background
+            if(!m_Startup.IsPrinted() && m_Workspace->IsLoaded()){
+                m_Startup.Add("Frame with the shown panels loaded", frame_begin);
+                m_Startup.Print(m_Workspace->GetLogger());
+            }
         }
         GPU::WaitIdle();
     }
 
     void OnImGui(){
         m_Dockspace->Draw();
-        m_ConsoleWindow.Draw();
-        m_DrinksList.Draw();
-        m_OrdersLog.Draw();
-        m_WaitersList.Draw();
-        m_SourcesList.Draw();
-        m_GobletsList.Draw();
-        m_Analytics.Draw();
-        m_DrinksTransfer.Draw();
+        m_Workspace->Draw();
         //ImGui::ShowDemoWindow();
     }
 
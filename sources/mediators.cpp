@@ -1,5 +1,9 @@
 #include "database.cpp"
 #include <tuple>
+#include <iterator>
+#include <type_traits>
+#include <map>
+#include <limits>
 
 struct Date{
     int Day = 1;
@@ -10,72 +14,131 @@ struct Date{
 template<typename...Types>
 using TableRow = std::tuple<Types...>;
 
+template<auto ...Members>
+struct ColumnList{};
 
-template<const char *Name, typename Type>
-struct TableColumnSpecification {};
+// Specialized for every row struct: table name, column names and the members
+// they decode into, in the same order
+template<typename RowType>
+struct TableSchema;
 
 template <typename Type, size_t Index>
-struct Extracter {
-
-    static Type Extract(const QueryResult &result) {
-        static_assert(false, "");
-        return {};
-    }
-};
+struct Extracter;
 
+// Sources are QueryResult cursors or MaterializedResult rows, they share the getters
 template <size_t Index>
 struct Extracter<int, Index>{
-    static int Extract(const QueryResult &result) {
+    template<typename SourceType>
+    static int Extract(const SourceType &result) {
         return result.GetColumnInt(Index);
     }
 };
 
 template <size_t Index>
 struct Extracter<float, Index>{
-    static float Extract(const QueryResult &result) {
+    template<typename SourceType>
+    static float Extract(const SourceType &result) {
         return result.GetColumnFloat(Index);
     }
 };
 
 template <size_t Index>
 struct Extracter<double, Index>{
-    static double Extract(const QueryResult &result) {
+    template<typename SourceType>
+    static double Extract(const SourceType &result) {
         return result.GetColumnDouble(Index);
     }
 };
 
 template <size_t Index>
 struct Extracter<const char *, Index>{
-    static const char *Extract(const QueryResult &result) {
+    template<typename SourceType>
+    static const char *Extract(const SourceType &result) {
         return result.GetColumnString(Index);
     }
 };
 
-template<size_t Index, typename ...Types>
-void Assign(TableRow<Types...> &row, const QueryResult &result)
-{
-    using AssignType = std::remove_const_t<std::remove_reference_t<decltype(std::get<Index>(row))>>;
-    std::get<Index>(row) = Extracter<AssignType, Index>::Extract(result)
-}
+template<typename MemberType>
+struct MemberTraits;
 
-template <typename...Types>
+template<typename RowType, typename FieldType>
+struct MemberTraits<FieldType RowType::*>{
+    using Row = RowType;
+    using Type = FieldType;
+};
+
+template<typename RowType>
+struct RowDecoder{
+    using Schema = TableSchema<RowType>;
+
+    template<typename SourceType>
+    static void Decode(RowType &row, const SourceType &result){
+        Decode(row, result, typename Schema::Columns());
+    }
+private:
+    template<typename SourceType, auto ...Members>
+    static void Decode(RowType &row, const SourceType &result, ColumnList<Members...>){
+        static_assert(sizeof...(Members) == std::size(Schema::ColumnNames), "Column names and members are out of sync");
+        Decode<SourceType, Members...>(row, result, std::make_index_sequence<sizeof...(Members)>());
+    }
+
+    template<typename SourceType, auto ...Members, size_t ...Index>
+    static void Decode(RowType &row, const SourceType &result, std::index_sequence<Index...>){
+        ((row.*Members = Extracter<typename MemberTraits<decltype(Members)>::Type, Index>::Extract(result)), ...);
+    }
+};
+
+template<typename ...Types>
+struct RowDecoder<TableRow<Types...>>{
+    template<typename SourceType>
+    static void Decode(TableRow<Types...> &row, const SourceType &result){
+        Decode(row, result, std::index_sequence_for<Types...>());
+    }
+private:
+    template<typename SourceType, size_t ...Index>
+    static void Decode(TableRow<Types...> &row, const SourceType &result, std::index_sequence<Index...>){
+        ((std::get<Index>(row) = Extracter<Types, Index>::Extract(result)), ...);
+    }
+};
+
+// String fields point into the shared buffer and live as long as any copy of it
+template <typename RowType>
+class TypedMaterializedResult{
+    MaterializedResult m_Result;
+public:
+    TypedMaterializedResult(MaterializedResult result):
+        m_Result(Move(result))
+    {}
+
+    RowType operator[](size_t index)const{
+        RowType row{};
+        RowDecoder<RowType>::Decode(row, m_Result.RowAt(index));
+        return row;
+    }
+
+    size_t Size()const{
+        return m_Result.RowCount();
+    }
+
+    const MaterializedResult &Raw()const{
+        return m_Result;
+    }
+};
+
+template <typename RowType>
 class TypedQueryResult{
     QueryResult m_QueryResult;
 public:
-    TypedQueryResult(QueryResult query_result): 
-        m_QueryResult(query_result) 
+    TypedQueryResult(QueryResult &&query_result): 
+        m_QueryResult(Move(query_result)) 
     {}
 
-    TableRow<Types> Current()const{ 
-        return MakeCurrent(std::make_index_sequence<sizeof..Types>());
-    }
-    
-    template <size_t ...Index>
-    TableRow<Types> MakeCurrent(std::index_sequence<Index...> seq) const
-    {
-        TableRow<Types> result;
-        std::initializer_list<int>{(Assign<Index>(result, m_QueryResult), 0)...};
-        return result;
+    // String fields point into the cursor and stay valid until Next() or Reset()
+    RowType Current()const{ 
+        RowType row{};
+        if(m_QueryResult)
+            RowDecoder<RowType>::Decode(row, m_QueryResult);
+        return row;
     }
 
     void Next() { 
@@ -89,425 +152,709 @@ public:
     operator bool() const{ 
         return m_QueryResult;
     }
+
+    const QueryResult &Raw()const{
+        return m_QueryResult;
+    }
+
+    TypedMaterializedResult<RowType> Materialize(){
+        return m_QueryResult.Materialize();
+    }
 };
 
-template <const char *TableName>
-class TableMediator{
-private:
-    Database &m_DB;
-public:
-    TableMediator(Database &db): 
-        m_DB(db) 
-    {}
-#if 0
-    TypedQueryResult<Types> Query()
-    {
-        return m_Database.Query(Stmt("SELECT * FROM %", TableName));
+// Statement text assembled at compile time from the schema, so every mediator
+// query is a string literal by the time it reaches the statement cache
+struct SqlText{
+    static constexpr size_t Capacity = 512;
+
+    char Data[Capacity] = {};
+    size_t Length = 0;
+
+    constexpr SqlText &Append(const char *string){
+        while(*string)
+            Data[Length++] = *string++;
+        return *this;
     }
+};
+
+template<typename RowType>
+constexpr SqlText SelectFrom(const char *condition = ""){
+    using Schema = TableSchema<RowType>;
 
-    template<const char *Name, template Type>
-    TypedQueryResult<Types> Query(Type value)
-    {
-        return m_Database.Query(Stmt("SELECT * FROM %", TableName));
+    SqlText sql;
+    sql.Append("SELECT ");
+    for(size_t i = 0; i < std::size(Schema::ColumnNames); i++){
+        if(i)
+            sql.Append(", ");
+        sql.Append(Schema::ColumnNames[i]);
     }
-#endif
+    sql.Append(" FROM ").Append(Schema::Name).Append(condition);
+    return sql;
+}
+
+template<auto Left, auto Right>
+constexpr bool IsSameMember(){
+    if constexpr(std::is_same_v<decltype(Left), decltype(Right)>)
+        return Left == Right;
+    else
+        return false;
+}
+
+template<auto Member, auto ...Members>
+constexpr size_t ColumnIndex(ColumnList<Members...>){
+    size_t index = 0;
+    size_t result = -1;
+    ((IsSameMember<Member, Members>() ? result = index++ : index++), ...);
+    return result;
+}
+
+template<auto Member>
+constexpr SqlText SelectWhereEquals(){
+    using RowType = typename MemberTraits<decltype(Member)>::Row;
+    using Schema = TableSchema<RowType>;
+
+    constexpr size_t index = ColumnIndex<Member>(typename Schema::Columns());
+    static_assert(index < std::size(Schema::ColumnNames), "Member is not a column of the table");
+
+    SqlText sql = SelectFrom<RowType>(" WHERE ");
+    sql.Append(Schema::ColumnNames[index]).Append(" = ?");
+    return sql;
+}
+
+template<typename RowType>
+struct TableStatements{
+    static constexpr SqlText Select = SelectFrom<RowType>();
+    static constexpr SqlText Delete = SqlText().Append("DELETE FROM ").Append(TableSchema<RowType>::Name);
 };
 
-class DrinksTableMediator{
-private:
+template<auto Member>
+struct SelectByStatement{
+    static constexpr SqlText Text = SelectWhereEquals<Member>();
+};
+
+template<typename RowType>
+struct KeysetStatements{
+    // Rows past the 'offset' first ones with an ID over the given one
+    static constexpr SqlText After = SelectFrom<RowType>(" WHERE ID > ? ORDER BY ID LIMIT ? OFFSET ?");
+    // The same counted down from an ID under the given one, handed back in ID order
+    static constexpr SqlText Before = SqlText()
+        .Append("SELECT * FROM (")
+        .Append(SelectFrom<RowType>(" WHERE ID < ? ORDER BY ID DESC LIMIT ? OFFSET ?").Data)
+        .Append(") ORDER BY ID");
+};
+
+template <typename RowType>
+class TableMediator{
+protected:
     Database &m_Database;
 public:
-    DrinksTableMediator(Database &db):
-            m_Database(db)
+    using Row = RowType;
+    using Result = TypedQueryResult<RowType>;
+
+    TableMediator(Database &db): 
+        m_Database(db) 
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM Drinks"));
+    Result Query(){
+        return m_Database.Query(TableStatements<RowType>::Select.Data);
     }
 
-    QueryResult Query(int id){
-        return m_Database.Query(Stmt("SELECT * FROM Drinks WHERE ID = %", id));
+    template<auto Member, typename Type>
+    Result QueryBy(const Type &value){
+        return m_Database.Query(SelectByStatement<Member>::Text.Data, value);
     }
 
-    QueryResult Query(const char *name){
-        return m_Database.Query(Stmt("SELECT * FROM Drinks WHERE Name = %", name));
+    void Clear(){
+        m_Database.Execute(TableStatements<RowType>::Delete.Data);
     }
 
-    void Clear(){
-        m_Database.Execute(Stmt("DELETE FROM Drinks"));
+    size_t Size(){
+        return m_Database.Size(TableSchema<RowType>::Name);
     }
 
-    void Add(int id, const char *name, float price_per_liter, int age_restriction){
-        m_Database.Execute(
-                Stmt(
-                        "INSERT INTO Drinks(ID, Name, PricePerLiter, AgeRestriction) VALUES(%,'%',%,%)",
-                        id,
-                        name,
-                        price_per_liter,
-                        age_restriction
-                )
-        );
+    // Ids for rows a bulk path adds with explicit ids, returns the first of 'count' or -1
+    sqlite3_int64 ReserveIDs(sqlite3_int64 count){
+        return m_Database.ReserveIDs(TableSchema<RowType>::Name, count);
     }
 
-    size_t Size(){
-        return m_Database.Size("Drinks");
+    Database &GetDatabase(){
+        return m_Database;
+    }
+protected:
+    // A nullptr id has the engine assign one. Returns the id of the row or -1
+    template<typename ...ArgsType>
+    int Insert(const char *sql, const ArgsType &...args){
+        if(!m_Database.Execute(sql, args...))
+            return -1;
+        return (int)m_Database.LastInsertID();
     }
 };
 
-class GobletsTableMediator{
+// The rows of a table keyed by ID, in ID order, read a page at a time for
+// views that only show a few of them. A page is read from the keys of a
+// neighbour read before, "WHERE ID > last ID of the page before", so it costs
+// an index seek however deep it is. A page with no neighbour read counts its
+// OFFSET from the nearest page that was, or from either end of the table.
+template<typename RowType>
+class KeysetPager{
+public:
+    static constexpr size_t DefaultPageSize = 64;
 private:
+    using Schema = TableSchema<RowType>;
+    using Statements = KeysetStatements<RowType>;
+
+    struct PageKeys{
+        sqlite3_int64 FirstID;
+        sqlite3_int64 LastID;
+        size_t RowCount;
+    };
+
+    struct Page{
+        TypedMaterializedResult<RowType> Rows;
+        uint64_t LastUsed;
+    };
+
     Database &m_Database;
-    int m_LastID{(int)m_Database.Size("Goblets")};
+    std::shared_ptr<ChangeSubscription> m_Changes;
+    const size_t m_PageSize;
+
+    size_t m_RowCount = 0;
+    uint64_t m_Frame = 0;
+    // Keys outlive the pages, they are the cheap way back to a page
+    std::map<size_t, PageKeys> m_Keys;
+    std::map<size_t, Page> m_Pages;
 public:
-    GobletsTableMediator(Database &db):
-            m_Database(db)
+    KeysetPager(Database &db, size_t page_size = DefaultPageSize):
+        m_Database(db),
+        m_Changes(db.SubscribeChanges()),
+        m_PageSize(page_size)
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM Goblets"));
-    }
+    // Call once a frame before Fetch(), drops pages the last frame didn't use
+    // and whatever changes of the table made stale
+    void Update(){
+        if(m_Changes->ConsumeOverflow())
+            Invalidate(std::numeric_limits<sqlite3_int64>::min());
 
-    QueryResult Query(int id){
-        return m_Database.Query(Stmt("SELECT * FROM Goblets WHERE ID = %", id));
-    }
+        RowChange change;
+        while(m_Changes->Poll(change)){
+            if(change.IsOn(Schema::Name))
+                Invalidate(change.RowID);
+        }
+
+        m_Frame++;
+        for(auto it = m_Pages.begin(); it != m_Pages.end();){
+            if(it->second.LastUsed + 1 < m_Frame)
+                it = m_Pages.erase(it);
+            else
+                ++it;
+        }
 
-    QueryResult Query(const char *name){
-        return m_Database.Query(Stmt("SELECT * FROM Goblets WHERE Name = %", name));
+        m_RowCount = m_Database.Size(Schema::Name);
     }
 
-    void Clear(){
-        m_LastID = 0;
-        m_Database.Execute(Stmt("DELETE FROM Goblets"));
+    size_t Size()const{
+        return m_RowCount;
     }
 
-    void Add(const char *name, float capacity){
-        m_Database.Execute(
-                Stmt(
-                        "INSERT INTO Goblets(ID, Name, Capacity) VALUES(%, '%', %)",
-                        ++m_LastID,
-                        name,
-                        capacity
-                )
-        );
+    // Reads the pages holding rows [begin, end) and 'margin' rows around them
+    void Fetch(size_t begin, size_t end, size_t margin = DefaultPageSize){
+        end = std::min(end + margin, m_RowCount);
+        begin = begin > margin ? begin - margin : 0;
+        if(begin >= end)
+            return;
+
+        for(size_t page = begin / m_PageSize; page <= (end - 1) / m_PageSize; page++){
+            auto it = m_Pages.find(page);
+            if(it == m_Pages.end())
+                it = m_Pages.emplace(page, Page{Read(page), 0}).first;
+            it->second.LastUsed = m_Frame;
+        }
     }
 
-    size_t Size(){
-        return m_Database.Size("Goblets");
+    // False when the row wasn't fetched or the table got shorter than it was counted
+    bool Get(size_t index, RowType &row)const{
+        auto it = m_Pages.find(index / m_PageSize);
+        if(it == m_Pages.end() || index % m_PageSize >= it->second.Rows.Size())
+            return false;
+        row = it->second.Rows[index % m_PageSize];
+        return true;
+    }
+private:
+    TypedMaterializedResult<RowType> Read(size_t page){
+        const size_t first_row = page * m_PageSize;
+        const size_t limit = std::min(m_PageSize, m_RowCount - first_row);
+
+        // Rows to skip when counting up from the start or from a page below,
+        // or down from the end or from a page above, the cheapest one is taken
+        sqlite3_int64 after = std::numeric_limits<sqlite3_int64>::min();
+        size_t after_offset = first_row;
+        sqlite3_int64 before = std::numeric_limits<sqlite3_int64>::max();
+        size_t before_offset = m_RowCount - first_row - limit;
+
+        auto above = m_Keys.upper_bound(page);
+        if(above != m_Keys.end() && (above->first - page) * m_PageSize - limit < before_offset){
+            before = above->second.FirstID;
+            before_offset = (above->first - page) * m_PageSize - limit;
+        }
+        auto below = m_Keys.lower_bound(page);
+        if(below != m_Keys.begin() && (--below)->second.RowCount == m_PageSize){
+            after = below->second.LastID;
+            after_offset = (page - below->first - 1) * m_PageSize;
+        }
+
+        MaterializedResult rows = after_offset <= before_offset
+            ? m_Database.Query(Statements::After.Data, after, (sqlite3_int64)limit, (sqlite3_int64)after_offset).Materialize()
+            : m_Database.Query(Statements::Before.Data, before, (sqlite3_int64)limit, (sqlite3_int64)before_offset).Materialize();
+
+        if(rows.RowCount())
+            m_Keys[page] = {rows.RowAt(0).GetColumnInt64(0), rows.RowAt(rows.RowCount() - 1).GetColumnInt64(0), rows.RowCount()};
+        return rows;
+    }
+
+    // Rows from 'id' on may have moved, so pages at or past it are read again,
+    // as is the last one, which may have been short, and any that came back empty
+    void Invalidate(sqlite3_int64 id){
+        for(auto it = m_Keys.begin(); it != m_Keys.end();){
+            if(it->second.LastID >= id || it->second.RowCount != m_PageSize)
+                it = m_Keys.erase(it);
+            else
+                ++it;
+        }
+        for(auto it = m_Pages.begin(); it != m_Pages.end();){
+            if(!m_Keys.count(it->first))
+                it = m_Pages.erase(it);
+            else
+                ++it;
+        }
     }
 };
 
-class OrdersLogTableMediator{
-private:
-    Database &m_Database;
-    int m_LastID{(int)m_Database.Size("OrdersLog")};
+struct AddressRow{
+    int ID;
+    const char *City;
+    const char *House;
+    int PostalCode;
+};
+
+template<>
+struct TableSchema<AddressRow>{
+    static constexpr const char Name[] = "Addresses";
+    static constexpr const char *ColumnNames[] = {"ID", "City", "House", "PostalCode"};
+    using Columns = ColumnList<&AddressRow::ID, &AddressRow::City, &AddressRow::House, &AddressRow::PostalCode>;
+};
+
+struct SourceRow{
+    int ID;
+    const char *Name;
+    int AddressID;
+};
+
+template<>
+struct TableSchema<SourceRow>{
+    static constexpr const char Name[] = "Sources";
+    static constexpr const char *ColumnNames[] = {"ID", "Name", "AddressID"};
+    using Columns = ColumnList<&SourceRow::ID, &SourceRow::Name, &SourceRow::AddressID>;
+};
+
+struct IngredientRow{
+    int ID;
+    const char *Name;
+    const char *Units;
+    int SourceID;
+};
+
+template<>
+struct TableSchema<IngredientRow>{
+    static constexpr const char Name[] = "Ingredients";
+    static constexpr const char *ColumnNames[] = {"ID", "Name", "Units", "SourceID"};
+    using Columns = ColumnList<&IngredientRow::ID, &IngredientRow::Name, &IngredientRow::Units, &IngredientRow::SourceID>;
+};
+
+struct DrinkRow{
+    int ID;
+    const char *Name;
+    float PricePerLiter;
+    int AgeRestriction;
+};
+
+template<>
+struct TableSchema<DrinkRow>{
+    static constexpr const char Name[] = "Drinks";
+    static constexpr const char *ColumnNames[] = {"ID", "Name", "PricePerLiter", "AgeRestriction"};
+    using Columns = ColumnList<&DrinkRow::ID, &DrinkRow::Name, &DrinkRow::PricePerLiter, &DrinkRow::AgeRestriction>;
+};
+
+struct IngredientDrinkRow{
+    int IngredientID;
+    float UnitsCount;
+    int DrinkID;
+};
+
+template<>
+struct TableSchema<IngredientDrinkRow>{
+    static constexpr const char Name[] = "IngredientsDrinks";
+    static constexpr const char *ColumnNames[] = {"IngredientID", "UnitsCount", "DrinkID"};
+    using Columns = ColumnList<&IngredientDrinkRow::IngredientID, &IngredientDrinkRow::UnitsCount, &IngredientDrinkRow::DrinkID>;
+};
+
+struct WaiterRow{
+    int ID;
+    const char *ShortName;
+    float Salary;
+    int FullAge;
+};
+
+template<>
+struct TableSchema<WaiterRow>{
+    static constexpr const char Name[] = "Waiters";
+    static constexpr const char *ColumnNames[] = {"ID", "ShortName", "Salary", "FullAge"};
+    using Columns = ColumnList<&WaiterRow::ID, &WaiterRow::ShortName, &WaiterRow::Salary, &WaiterRow::FullAge>;
+};
+
+struct GobletRow{
+    int ID;
+    const char *Name;
+    float Capacity;
+};
+
+template<>
+struct TableSchema<GobletRow>{
+    static constexpr const char Name[] = "Goblets";
+    static constexpr const char *ColumnNames[] = {"ID", "Name", "Capacity"};
+    using Columns = ColumnList<&GobletRow::ID, &GobletRow::Name, &GobletRow::Capacity>;
+};
+
+struct OrderRow{
+    int ID;
+    const char *CustomerShortName;
+    float Tips;
+    int WaiterID;
+    float Checkout;
+    const char *OrderDate;
+};
+
+template<>
+struct TableSchema<OrderRow>{
+    static constexpr const char Name[] = "OrdersLog";
+    static constexpr const char *ColumnNames[] = {"ID", "CustomerShortName", "Tips", "WaiterID", "Checkout", "OrderDate"};
+    using Columns = ColumnList<&OrderRow::ID, &OrderRow::CustomerShortName, &OrderRow::Tips, &OrderRow::WaiterID, &OrderRow::Checkout, &OrderRow::OrderDate>;
+};
+
+struct DrinkOrderRow{
+    int OrderID;
+    int DrinkID;
+    int GobletID;
+};
+
+template<>
+struct TableSchema<DrinkOrderRow>{
+    static constexpr const char Name[] = "DrinkOrders";
+    static constexpr const char *ColumnNames[] = {"OrderID", "DrinkID", "GobletID"};
+    using Columns = ColumnList<&DrinkOrderRow::OrderID, &DrinkOrderRow::DrinkID, &DrinkOrderRow::GobletID>;
+};
+
+class DrinksTableMediator: public TableMediator<DrinkRow>{
 public:
-    OrdersLogTableMediator(Database &db):
-            m_Database(db)
+    static constexpr const char InsertStatement[] = "INSERT INTO Drinks(ID, Name, PricePerLiter, AgeRestriction) VALUES(?, ?, ?, ?)";
+
+    DrinksTableMediator(Database &db):
+            TableMediator(db)
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM OrdersLog"));
-    }
+    using TableMediator::Query;
 
-    QueryResult Query(const Date &begin, const Date &end){
-        return m_Database.Query(Stmt("SELECT * FROM OrdersLog WHERE OrderDate BETWEEN '%-%-%' AND '%-%-%'", begin.Year, begin.Month, begin.Day, end.Year, end.Month, end.Day));
+    Result Query(int id){
+        return QueryBy<&DrinkRow::ID>(id);
     }
 
-    void Clear(){
-        m_LastID = 0;
-        m_Database.Execute(Stmt("DELETE FROM OrdersLog"));
+    Result Query(const char *name){
+        return QueryBy<&DrinkRow::Name>(name);
     }
 
-    int Add(const char *customer_name, float tips, int waiter_id, float checkout, Date date){
-        ++m_LastID;
-        m_Database.Execute(
-                Stmt(
-                        "INSERT INTO OrdersLog(ID, CustomerShortName, Tips, WaiterID, Checkout, OrderDate) VALUES(%,'%',%,%, %, '%-%-%')",
-                        m_LastID,
-                        customer_name,
-                        tips,
-                        waiter_id,
-                        checkout,
-                        date.Year,
-                        date.Month,
-                        date.Day
-                )
-        );
-        return m_LastID;
+    // Returns -1 when the drink was not inserted
+    int Add(const char *name, float price_per_liter, int age_restriction){
+        return Insert(InsertStatement, nullptr, name, price_per_liter, age_restriction);
     }
 
-    size_t Size(){
-        return m_Database.Size("OrdersLog");
+    // 'id' comes from ReserveIDs()
+    int Add(int id, const char *name, float price_per_liter, int age_restriction){
+        return Insert(InsertStatement, id, name, price_per_liter, age_restriction);
     }
 };
 
-class DrinkOrdersTableMediator{
-private:
-    Database &m_Database;
+class GobletsTableMediator: public TableMediator<GobletRow>{
 public:
-    DrinkOrdersTableMediator(Database &db):
-            m_Database(db)
+    GobletsTableMediator(Database &db):
+            TableMediator(db)
     {}
 
-    QueryResult Query(int order_id){
-        return m_Database.Query(Stmt("SELECT * FROM DrinkOrders WHERE OrderID = %", order_id));
+    using TableMediator::Query;
+
+    Result Query(int id){
+        return QueryBy<&GobletRow::ID>(id);
     }
 
-    void Clear(){
-        m_Database.Execute(Stmt("DELETE FROM DrinkOrders"));
+    Result Query(const char *name){
+        return QueryBy<&GobletRow::Name>(name);
     }
 
-    void Add(int order_id, int drink_id, int goblet_id){
-        m_Database.Execute(
-                Stmt(
-                        "INSERT INTO DrinkOrders(OrderID, DrinkID, GobletID) VALUES(%, %, %)",
-                        order_id,
-                        drink_id,
-                        goblet_id
-                )
+    int Add(const char *name, float capacity){
+        return Insert(
+                "INSERT INTO Goblets(ID, Name, Capacity) VALUES(?, ?, ?)",
+                nullptr,
+                name,
+                capacity
         );
     }
 };
 
-class WaitersTableMediator{
-private:
-    Database &m_Database;
-    int m_LastID{(int)m_Database.Size("Waiters")};
+class OrdersLogTableMediator: public TableMediator<OrderRow>{
 public:
-    WaitersTableMediator(Database &db):
-            m_Database(db)
+    static constexpr SqlText SelectBetween = SelectFrom<OrderRow>(
+        " WHERE OrderDate BETWEEN ? || '-' || ? || '-' || ? AND ? || '-' || ? || '-' || ?"
+    );
+    static constexpr const char InsertStatement[] = 
+        "INSERT INTO OrdersLog(ID, CustomerShortName, Tips, WaiterID, Checkout, OrderDate) VALUES(?, ?, ?, ?, ?, ? || '-' || ? || '-' || ?)";
+
+    OrdersLogTableMediator(Database &db):
+            TableMediator(db)
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM Waiters"));
-    }
+    using TableMediator::Query;
 
-    int Add(const char *name, float salary, int age){
-        ++m_LastID;
-        m_Database.Execute(
-                Stmt(
-                        "INSERT INTO Waiters(ID, ShortName, Salary, FullAge) VALUES(%, '%', %, %)",
-                        m_LastID,
-                        name,
-                        salary,
-                        age
-                )
+    Result Query(const Date &begin, const Date &end){
+        return m_Database.Query(
+                SelectBetween.Data,
+                begin.Year, begin.Month, begin.Day, 
+                end.Year, end.Month, end.Day
         );
-        return m_LastID;
     }
 
-    QueryResult Query(const char *name){
-        return m_Database.Query(Stmt("SELECT * FROM Waiters WHERE ShortName = '%'", name));
+    // Returns -1 when the order was not inserted
+    int Add(const char *customer_name, float tips, int waiter_id, float checkout, Date date){
+        return Insert(InsertStatement, nullptr, customer_name, tips, waiter_id, checkout, date.Year, date.Month, date.Day);
     }
 
-    QueryResult Query(int id){
-        return m_Database.Query(Stmt("SELECT * FROM Waiters WHERE ID = %", id));
+    // 'id' comes from ReserveIDs()
+    int Add(int id, const char *customer_name, float tips, int waiter_id, float checkout, Date date){
+        return Insert(InsertStatement, id, customer_name, tips, waiter_id, checkout, date.Year, date.Month, date.Day);
     }
+};
 
-    bool Exists(const char *name){
-        return Query(name);
-    }
+class DrinkOrdersTableMediator: public TableMediator<DrinkOrderRow>{
+public:
+    DrinkOrdersTableMediator(Database &db):
+            TableMediator(db)
+    {}
 
-    size_t Size(){
-        return m_Database.Size("Waiters");
+    Result Query(int order_id){
+        return QueryBy<&DrinkOrderRow::OrderID>(order_id);
     }
 
-    void Clear(){
-        m_LastID = 0;
-        m_Database.Execute(Stmt("DELETE FROM Waiters"));
+    bool Add(int order_id, int drink_id, int goblet_id){
+        return m_Database.Execute(
+                "INSERT INTO DrinkOrders(OrderID, DrinkID, GobletID) VALUES(?, ?, ?)",
+                order_id,
+                drink_id,
+                goblet_id
+        );
     }
 };
 
-class IngredientsTableMediator{
-private:
-    Database &m_Database;
-    int m_LastID{(int)m_Database.Size("Ingredients")};
+class WaitersTableMediator: public TableMediator<WaiterRow>{
 public:
-    IngredientsTableMediator(Database &db):
-            m_Database(db)
+    WaitersTableMediator(Database &db):
+            TableMediator(db)
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM Ingredients"));
-    }
+    using TableMediator::Query;
 
-    int Add(const char *name, const char *units, int source_id){
-        ++m_LastID;
-        m_Database.Execute(
-                Stmt(
-                    "INSERT INTO Ingredients(ID, Name, Units, SourceID) VALUES(%, '%', '%', %)",
-                    m_LastID,
-                    name,
-                    units,
-                    source_id
-                )
+    // Returns -1 when the waiter was not inserted, ValidateWaiterAge rejects the underaged
+    int Add(const char *name, float salary, int age){
+        return Insert(
+                "INSERT INTO Waiters(ID, ShortName, Salary, FullAge) VALUES(?, ?, ?, ?)",
+                nullptr,
+                name,
+                salary,
+                age
         );
-        return m_LastID;
     }
 
-    QueryResult Query(int id){
-        return m_Database.Query(Stmt("SELECT * FROM Ingredients WHERE ID = %", id));
+    Result Query(const char *name){
+        return QueryBy<&WaiterRow::ShortName>(name);
     }
 
-    void Clear(){
-        m_Database.Execute(Stmt("DELETE FROM Ingredients"));
+    Result Query(int id){
+        return QueryBy<&WaiterRow::ID>(id);
     }
 
-    size_t Size(){
-        m_LastID = 0;
-        return m_Database.Size("Ingredients");
+    bool Exists(const char *name){
+        return Query(name);
     }
 };
 
+class IngredientsTableMediator: public TableMediator<IngredientRow>{
+public:
+    IngredientsTableMediator(Database &db):
+            TableMediator(db)
+    {}
 
+    using TableMediator::Query;
 
-class IngredientsDrinksTableMediator{
-private:
-    Database &m_Database;
+    int Add(const char *name, const char *units, int source_id){
+        return Insert(
+                "INSERT INTO Ingredients(ID, Name, Units, SourceID) VALUES(?, ?, ?, ?)",
+                nullptr,
+                name,
+                units,
+                source_id
+        );
+    }
+
+    Result Query(int id){
+        return QueryBy<&IngredientRow::ID>(id);
+    }
+};
+
+class IngredientsDrinksTableMediator: public TableMediator<IngredientDrinkRow>{
 public:
     IngredientsDrinksTableMediator(Database &db):
-            m_Database(db)
+            TableMediator(db)
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM IngredientsDrinks"));
-    }
+    using TableMediator::Query;
 
     void Add(int ingredient_id, float units, int drink_id){
         m_Database.Execute(
-                Stmt(
-                        "INSERT INTO IngredientsDrinks(IngredientID, UnitsCount, DrinkID) VALUES(%, %, %)",
-                        ingredient_id,
-                        units,
-                        drink_id
-                )
+                "INSERT INTO IngredientsDrinks(IngredientID, UnitsCount, DrinkID) VALUES(?, ?, ?)",
+                ingredient_id,
+                units,
+                drink_id
         );
     }
 
-    QueryResult Query(int drink_id){
-        return m_Database.Query(Stmt("SELECT * FROM IngredientsDrinks WHERE DrinkID = %", drink_id));
-    }
-
-    void Clear(){
-        m_Database.Execute(Stmt("DELETE FROM IngredientsDrinks"));
+    Result Query(int drink_id){
+        return QueryBy<&IngredientDrinkRow::DrinkID>(drink_id);
     }
 };
 
-class SourcesTableMediator{
-private:
-    Database &m_Database;
-    int m_LastID{(int)m_Database.Size("Sources")};
+class SourcesTableMediator: public TableMediator<SourceRow>{
 public:
     SourcesTableMediator(Database &db):
-            m_Database(db)
+            TableMediator(db)
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM Sources"));
-    }
+    using TableMediator::Query;
 
     int Add(const char *name, int address_id){
-        ++m_LastID;
-        m_Database.Execute(
-                Stmt(
-                        "INSERT INTO Sources(ID, Name, AddressID) VALUES(%, '%', %)",
-                        m_LastID,
-                        name,
-                        address_id
-                )
+        return Insert(
+                "INSERT INTO Sources(ID, Name, AddressID) VALUES(?, ?, ?)",
+                nullptr,
+                name,
+                address_id
         );
-        return m_LastID;
-    }
-
-    QueryResult Query(int id){
-        return m_Database.Query(Stmt("SELECT * FROM Sources WHERE ID = %", id));
     }
 
-    void Clear(){
-        m_LastID = 0;
-        m_Database.Execute(Stmt("DELETE FROM Sources"));
-    }
-
-    size_t Size()const{
-        return m_Database.Size("Sources");
+    Result Query(int id){
+        return QueryBy<&SourceRow::ID>(id);
     }
 };
 
-class AddressesTableMediator{
-private:
-    Database &m_Database;
-    int m_LastID{(int)m_Database.Size("Addresses")};
+class AddressesTableMediator: public TableMediator<AddressRow>{
 public:
+    static constexpr SqlText SelectByLocation = SelectFrom<AddressRow>(" WHERE City = ? AND House = ? AND PostalCode = ?");
+
     AddressesTableMediator(Database &db):
-            m_Database(db)
+            TableMediator(db)
     {}
 
-    QueryResult Query(){
-        return m_Database.Query(Stmt("SELECT * FROM Addresses"));
-    }
+    using TableMediator::Query;
 
     int TryAdd(const char *city, const char *house, int postal_code){
         if(Query(city, house, postal_code))return 0;
 
-        ++m_LastID;
-        m_Database.Execute(
-                Stmt(
-                        "INSERT INTO Addresses(ID, City, House, PostalCode) VALUES(%, '%', '%', %)",
-                        m_LastID,
-                        city,
-                        house,
-                        postal_code
-                )
+        return Insert(
+                "INSERT INTO Addresses(ID, City, House, PostalCode) VALUES(?, ?, ?, ?)",
+                nullptr,
+                city,
+                house,
+                postal_code
         );
-
-        return m_LastID;
     }
 
-    QueryResult Query(const char *city, const char *house, int postal_code){
-        return m_Database.Query(Stmt("SELECT * FROM Addresses WHERE City = '%' AND House = '%' AND PostalCode = %", city, house, postal_code));
+    Result Query(const char *city, const char *house, int postal_code){
+        return m_Database.Query(SelectByLocation.Data, city, house, postal_code);
     }
 
-    QueryResult Query(int id){
-        return m_Database.Query(Stmt("SELECT * FROM Addresses WHERE ID = %", id));
-    }
-
-
-    void Clear(){
-        m_LastID = 0;
-        m_Database.Execute(Stmt("DELETE FROM Addresses"));
-    }
-
-    size_t Size()const{
-        return m_Database.Size("Addresses");
+    Result Query(int id){
+        return QueryBy<&AddressRow::ID>(id);
     }
 };
 
 class StoredProcedures {
     Database &m_Database;
 public:
+    // Foreign key columns are declared without a type, a unary + on the other side
+    // keeps the comparison in their affinity so their indexes stay usable
+    static constexpr SqlText SourcesWithCity = SelectFrom<SourceRow>(" WHERE AddressID IN (SELECT +ID FROM Addresses WHERE City = ?)");
+    static constexpr SqlText ExpensiveWaiters = SelectFrom<WaiterRow>(" WHERE Salary > ?");
+    static constexpr SqlText DrinksWith = SelectFrom<DrinkRow>(" WHERE Drinks.ID IN"
+                                                               "(SELECT DrinkID FROM IngredientsDrinks WHERE IngredientID IN"
+                                                               "(SELECT +ID FROM Ingredients WHERE Name = ?))");
+    static constexpr SqlText IngredientsCheaperThan = SelectFrom<IngredientRow>(" WHERE PricePerUnit < ?");
+    static constexpr SqlText GobletsLargerThan = SelectFrom<GobletRow>(" WHERE Capacity > ?");
+    static constexpr const char OrdersCountByWaiter[] = 
+        "SELECT Waiters.ShortName, COUNT(*) FROM OrdersLog "
+        "JOIN Waiters ON Waiters.ID = OrdersLog.WaiterID "
+        "WHERE OrderDate BETWEEN ? || '-' || ? || '-' || ? AND ? || '-' || ? || '-' || ? "
+        "GROUP BY OrdersLog.WaiterID";
+    static constexpr const char DrinksSoldCount[] = 
+        "SELECT Drinks.Name, COUNT(*) FROM OrdersLog "
+        "JOIN DrinkOrders ON DrinkOrders.OrderID = +OrdersLog.ID "
+        "JOIN Drinks ON Drinks.ID = DrinkOrders.DrinkID "
+        "WHERE OrderDate BETWEEN ? || '-' || ? || '-' || ? AND ? || '-' || ? || '-' || ? "
+        "GROUP BY DrinkOrders.DrinkID";
+
+    using NameCountRow = TableRow<const char *, int>;
+
     StoredProcedures(Database &db) :
             m_Database(db)
     {}
 
-    QueryResult GetAllSourcesWithCity(const char *city){
-        return m_Database.Query(Stmt("SELECT * FROM Sources WHERE AddressID IN (SELECT ID FROM Addresses WHERE City = '%')", city));
+    TypedQueryResult<SourceRow> GetAllSourcesWithCity(const char *city){
+        return m_Database.Query(SourcesWithCity.Data, city);
+    }
+
+    TypedQueryResult<WaiterRow> GetExpensiveWaiters(float salary_limit){
+        return m_Database.Query(ExpensiveWaiters.Data, salary_limit);
     }
 
-    QueryResult GetExpensiveWaiters(float salary_limit){
-        return m_Database.Query(Stmt("SELECT * FROM Waiters WHERE Salary > %", salary_limit));
+    TypedQueryResult<DrinkRow> GetDrinksWith(const char *ingredient_name){
+        return m_Database.Query(DrinksWith.Data, ingredient_name);
     }
 
-    QueryResult GetDrinksWith(const char *ingredient_name){
-        return m_Database.Query(Stmt("SELECT * FROM Drinks WHERE Drinks.ID IN"
-                                     "(SELECT DrinkID FROM IngredientsDrinks WHERE IngredientID IN"
-                                     "(SELECT ID FROM Ingredients WHERE Name = '%'))", ingredient_name));
+    TypedQueryResult<IngredientRow> GetIngredientsWithPriceLessThan(float price){
+        return m_Database.Query(IngredientsCheaperThan.Data, price);
     }
 
-    QueryResult GetIngredientsWithPriceLessThan(float price){
-        return m_Database.Query(Stmt("SELECT * FROM Ingredients WHERE PricePerUnit < %", price));
+    TypedQueryResult<GobletRow> GetGobletWithCapacityMoreThan(float capacity){
+        return m_Database.Query(GobletsLargerThan.Data, capacity);
     }
 
-    QueryResult GetGobletWithCapacityMoreThan(float capacity){
-        return m_Database.Query(Stmt("SELECT * FROM Goblets WHERE Capacity > %", capacity));
+    TypedQueryResult<NameCountRow> GetOrdersCountByWaiter(const Date &begin, const Date &end){
+        return m_Database.Query(
+                OrdersCountByWaiter,
+                begin.Year, begin.Month, begin.Day, 
+                end.Year, end.Month, end.Day
+        );
+    }
+
+    TypedQueryResult<NameCountRow> GetDrinksSoldCount(const Date &begin, const Date &end){
+        return m_Database.Query(
+                DrinksSoldCount,
+                begin.Year, begin.Month, begin.Day, 
+                end.Year, end.Month, end.Day
+        );
     }
 };
\ No newline at end of file
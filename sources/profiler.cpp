@@ -0,0 +1,350 @@
+#include <sqlite3.h>
+#include <deque>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+// One line per plan step, indented by its depth in the plan tree
+std::string ExplainQueryPlan(sqlite3 *db, const char *sql){
+    const std::string explain_sql = std::string("EXPLAIN QUERY PLAN ") + sql;
+
+    sqlite3_stmt *explain = nullptr;
+    if(sqlite3_prepare_v2(db, explain_sql.c_str(), -1, &explain, nullptr) != SQLITE_OK){
+        sqlite3_finalize(explain);
+        return {};
+    }
+
+    std::string plan;
+    std::vector<std::pair<int, int>> depths;
+    while(sqlite3_step(explain) == SQLITE_ROW){
+        const int id = sqlite3_column_int(explain, 0);
+        const int parent = sqlite3_column_int(explain, 1);
+
+        int depth = 0;
+        for(const auto &[node, node_depth]: depths){
+            if(node == parent)
+                depth = node_depth + 1;
+        }
+        depths.push_back({id, depth});
+
+        const char *detail = (const char *)sqlite3_column_text(explain, 3);
+        plan.append(depth * 2, ' ');
+        plan.append(detail ? detail : "");
+        plan.push_back('\n');
+    }
+    sqlite3_finalize(explain);
+    return plan;
+}
+
+// Executions that took longer than the threshold, with their bound values and
+// query plan. The latest entries are kept in memory for the console, all of
+// them go to a log file that is rotated once it grows past the size limit.
+class SlowQueryLog{
+public:
+    static constexpr int64_t DefaultThresholdNs = 5'000'000;
+    static constexpr size_t DefaultFileSize = 1024 * 1024;
+    static constexpr size_t DefaultFilesCount = 3;
+    static constexpr size_t EntriesCount = 64;
+
+    struct Entry{
+        std::time_t Time = 0;
+        int64_t DurationNs = 0;
+        uint64_t Rows = 0;
+        // Statement text with the bound values substituted
+        std::string Sql;
+        std::string Plan;
+    };
+private:
+    int64_t m_ThresholdNs = DefaultThresholdNs;
+    std::deque<Entry> m_Entries;
+    // Plans are taken once per statement text
+    std::unordered_map<std::string, std::string> m_Plans;
+
+    std::string m_FilePath;
+    std::FILE *m_File = nullptr;
+    size_t m_FileSize = 0;
+    size_t m_MaxFileSize = DefaultFileSize;
+    size_t m_FilesCount = DefaultFilesCount;
+public:
+    SlowQueryLog() = default;
+
+    SlowQueryLog(const SlowQueryLog &) = delete;
+
+    SlowQueryLog &operator=(const SlowQueryLog &) = delete;
+
+    ~SlowQueryLog(){
+        CloseFile();
+    }
+
+    // 'files_count' includes the one being written, older ones get .1, .2 ... suffixes
+    bool OpenFile(const char *filepath, size_t max_file_size = DefaultFileSize, size_t files_count = DefaultFilesCount){
+        CloseFile();
+        m_FilePath = filepath;
+        m_MaxFileSize = max_file_size;
+        m_FilesCount = files_count ? files_count : 1;
+        return ReopenFile();
+    }
+
+    void SetThreshold(int64_t threshold_ns){
+        m_ThresholdNs = threshold_ns;
+    }
+
+    int64_t Threshold()const{
+        return m_ThresholdNs;
+    }
+
+    bool IsSlow(int64_t elapsed_ns)const{
+        return elapsed_ns >= m_ThresholdNs;
+    }
+
+    // Must be called before the statement is reset, while its bindings are still in place
+    void Add(sqlite3_stmt *stmt, int64_t elapsed_ns, uint64_t rows){
+        Entry entry;
+        entry.Time = std::time(nullptr);
+        entry.DurationNs = elapsed_ns;
+        entry.Rows = rows;
+
+        char *expanded = sqlite3_expanded_sql(stmt);
+        entry.Sql = expanded ? expanded : sqlite3_sql(stmt);
+        sqlite3_free(expanded);
+
+        auto plan = m_Plans.find(sqlite3_sql(stmt));
+        if(plan == m_Plans.end())
+            plan = m_Plans.emplace(sqlite3_sql(stmt), ExplainQueryPlan(sqlite3_db_handle(stmt), sqlite3_sql(stmt))).first;
+        entry.Plan = plan->second;
+
+        Write(entry);
+
+        if(m_Entries.size() == EntriesCount)
+            m_Entries.pop_front();
+        m_Entries.push_back(Move(entry));
+    }
+
+    const std::deque<Entry> &Entries()const{
+        return m_Entries;
+    }
+
+    void Clear(){
+        m_Entries.clear();
+        m_Plans.clear();
+    }
+private:
+    void Write(const Entry &entry){
+        if(!m_File)
+            return;
+
+        char time[32];
+        std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S", std::localtime(&entry.Time));
+
+        const int written = std::fprintf(m_File, "[%s] %.3f ms, %llu rows\n%s\n%s\n",
+            time, entry.DurationNs / 1000000.0, (unsigned long long)entry.Rows, entry.Sql.c_str(), entry.Plan.c_str());
+        std::fflush(m_File);
+
+        if(written > 0)
+            m_FileSize += written;
+        if(m_FileSize >= m_MaxFileSize)
+            Rotate();
+    }
+
+    void Rotate(){
+        CloseFile();
+
+        auto name = [this](size_t index){
+            return index ? m_FilePath + "." + std::to_string(index) : m_FilePath;
+        };
+
+        std::remove(name(m_FilesCount - 1).c_str());
+        for(size_t i = m_FilesCount - 1; i > 0; i--)
+            std::rename(name(i - 1).c_str(), name(i).c_str());
+
+        ReopenFile();
+    }
+
+    bool ReopenFile(){
+        m_File = std::fopen(m_FilePath.c_str(), "a");
+        if(!m_File)
+            return false;
+
+        std::fseek(m_File, 0, SEEK_END);
+        m_FileSize = std::ftell(m_File);
+        return true;
+    }
+
+    void CloseFile(){
+        if(m_File)
+            std::fclose(m_File);
+        m_File = nullptr;
+    }
+};
+
+// Execution statistics of every distinct statement run on a connection, keyed
+// by the statement text as the cache normalized it. One execution spans from
+// the first step after a reset to the statement being released or reset again.
+// Only statements stepped through the cache are seen: scripts, which go through
+// sqlite3_exec, and PreparedStatement loops are left out.
+class QueryProfiler{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Percentiles are taken over this many latest executions
+    static constexpr size_t SamplesCount = 1024;
+
+    struct Record{
+        std::string Sql;
+        uint64_t Calls = 0;
+        uint64_t Rows = 0;
+        int64_t TotalNs = 0;
+        int64_t MaxNs = 0;
+        uint64_t FullScanSteps = 0;
+        uint64_t Sorts = 0;
+        uint64_t AutoIndexes = 0;
+        uint64_t VMSteps = 0;
+
+        std::vector<int64_t> Samples;
+        size_t NextSample = 0;
+
+        // The 99th percentile as of CachedP99Calls executions
+        mutable int64_t CachedP99Ns = 0;
+        mutable uint64_t CachedP99Calls = 0;
+
+        int64_t MeanNs()const{
+            return Calls ? TotalNs / (int64_t)Calls : 0;
+        }
+
+        int64_t PercentileNs(double percentile)const{
+            if(Samples.empty())
+                return 0;
+
+            std::vector<int64_t> sorted = Samples;
+            auto nth = sorted.begin() + std::min<size_t>(sorted.size() - 1, (size_t)(percentile * sorted.size()));
+            std::nth_element(sorted.begin(), nth, sorted.end());
+            return *nth;
+        }
+
+        // Taken again only once the statement ran since the last call
+        int64_t P99Ns()const{
+            if(CachedP99Calls != Calls){
+                CachedP99Ns = PercentileNs(0.99);
+                CachedP99Calls = Calls;
+            }
+            return CachedP99Ns;
+        }
+    };
+private:
+    std::deque<Record> m_Records;
+    std::unordered_map<std::string_view, Record *> m_Index;
+    SlowQueryLog m_SlowLog;
+    bool m_IsEnabled = true;
+public:
+    QueryProfiler() = default;
+
+    QueryProfiler(const QueryProfiler &) = delete;
+
+    QueryProfiler &operator=(const QueryProfiler &) = delete;
+
+    bool IsEnabled()const{
+        return m_IsEnabled;
+    }
+
+    void SetEnabled(bool is_enabled){
+        m_IsEnabled = is_enabled;
+    }
+
+    void Add(sqlite3_stmt *stmt, int64_t elapsed_ns, uint64_t rows){
+        // Counters are reset on every read so they describe this execution only
+        const uint64_t full_scan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        const uint64_t sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+        const uint64_t auto_indexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+        const uint64_t vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+
+        if(m_SlowLog.IsSlow(elapsed_ns))
+            m_SlowLog.Add(stmt, elapsed_ns, rows);
+
+        if(!m_IsEnabled)
+            return;
+
+        Record &record = Find(sqlite3_sql(stmt));
+        record.Calls++;
+        record.Rows += rows;
+        record.TotalNs += elapsed_ns;
+        record.MaxNs = std::max(record.MaxNs, elapsed_ns);
+        record.FullScanSteps += full_scan_steps;
+        record.Sorts += sorts;
+        record.AutoIndexes += auto_indexes;
+        record.VMSteps += vm_steps;
+
+        if(record.Samples.size() < SamplesCount)
+            record.Samples.push_back(elapsed_ns);
+        else
+            record.Samples[record.NextSample] = elapsed_ns;
+        record.NextSample = (record.NextSample + 1) % SamplesCount;
+    }
+
+    // Fed whether the profiler is enabled or not, disabling it only stops the statistics
+    SlowQueryLog &SlowLog(){
+        return m_SlowLog;
+    }
+
+    const std::deque<Record> &Records()const{
+        return m_Records;
+    }
+
+    // Executions of all statements since the last reset
+    uint64_t TotalCalls()const{
+        uint64_t calls = 0;
+        for(const Record &record: m_Records)
+            calls += record.Calls;
+        return calls;
+    }
+
+    void Reset(){
+        m_Index.clear();
+        m_Records.clear();
+    }
+private:
+    Record &Find(const char *sql){
+        auto it = m_Index.find(sql);
+        if(it != m_Index.end())
+            return *it->second;
+
+        Record &record = m_Records.emplace_back();
+        record.Sql = sql;
+        m_Index.emplace(record.Sql, &record);
+        return record;
+    }
+};
+
+// Accumulates the time spent stepping one execution of a statement
+class StepTimer{
+private:
+    int64_t m_ElapsedNs = 0;
+    uint64_t m_Rows = 0;
+    bool m_IsStarted = false;
+public:
+    // Always timed, the slow query log needs the time even while the profiler is disabled
+    int Step(sqlite3_stmt *stmt){
+        const auto begin = QueryProfiler::Clock::now();
+        const int status = sqlite3_step(stmt);
+        Count(QueryProfiler::Clock::now() - begin, status == SQLITE_ROW);
+        return status;
+    }
+
+    void Count(QueryProfiler::Clock::duration elapsed, uint64_t rows){
+        m_ElapsedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        m_Rows += rows;
+        m_IsStarted = true;
+    }
+
+    // Hands the execution over to the profiler and starts a new one
+    void Finish(sqlite3_stmt *stmt, QueryProfiler &profiler){
+        if(m_IsStarted)
+            profiler.Add(stmt, m_ElapsedNs, m_Rows);
+        *this = {};
+    }
+};
@@ -0,0 +1,329 @@
+#include <string>
+#include <string_view>
+
+// The schema as brewery.sqlite shipped it, existing databases already are at this
+// version in all but the user_version stamp
+static constexpr const char BaselineSchema[] = R"(
+CREATE TABLE IF NOT EXISTS Addresses(
+    ID int PRIMARY KEY NOT NULL,
+    City varchar(64),
+    House varchar(2),
+    PostalCode int
+);
+
+CREATE TABLE IF NOT EXISTS Sources(
+    ID int PRIMARY KEY NOT NULL,
+    Name varchar(64),
+    AddressID REFERENCES Addresses(ID)
+);
+
+CREATE TABLE IF NOT EXISTS Ingredients(
+    ID int PRIMARY KEY NOT NULL,
+    Name varchar(64) NOT NULL,
+    Units varchar(64) NOT NULL,
+    SourceID REFERENCES Sources(ID)
+);
+
+CREATE TABLE IF NOT EXISTS Drinks(
+    ID int PRIMARY KEY NOT NULL,
+    Name varchar(64),
+    PricePerLiter float,
+    AgeRestriction int
+);
+
+CREATE TABLE IF NOT EXISTS IngredientsDrinks(
+    IngredientID REFERENCES Ingredients(ID),
+    UnitsCount float,
+    DrinkID REFERENCES Drinks(ID)
+);
+
+CREATE TABLE IF NOT EXISTS Waiters(
+    ID int PRIMARY KEY NOT NULL,
+    ShortName varchar(64),
+    Salary float,
+    FullAge int
+);
+
+CREATE TABLE IF NOT EXISTS Goblets(
+    ID int PRIMARY KEY NOT NULL,
+    Name varchar(64),
+    Capacity float
+);
+
+CREATE TABLE IF NOT EXISTS OrdersLog(
+    ID int PRIMARY KEY NOT NULL,
+    CustomerShortName varchar(64),
+    Tips float,
+    WaiterID REFERENCES Waiters(ID),
+    Checkout float,
+    OrderDate date
+);
+
+CREATE TABLE IF NOT EXISTS DrinkOrders(
+    OrderID REFERENCES OrdersLog(ID),
+    DrinkID REFERENCES Drinks(ID),
+    GobletID REFERENCES Goblets(ID)
+);
+
+CREATE VIEW IF NOT EXISTS OrdersWithNameAndCount AS
+    SELECT OrdersLog.ID, CustomerShortName AS CustomerName, Tips, Waiters.ShortName AS WaiterName,
+    (SELECT count(*) FROM DrinkOrders WHERE OrderID == OrdersLog.ID) AS DrinksCount
+    FROM OrdersLog JOIN Waiters on Waiters.ID = OrdersLog.WaiterID;
+
+CREATE VIEW IF NOT EXISTS DrinksWithIngredientsCount AS
+    SELECT *, (SELECT count(*) FROM IngredientsDrinks WHERE DrinkID == ID) AS IngredientsCount
+    FROM Drinks;
+
+CREATE TRIGGER IF NOT EXISTS ValidateWaiterAge
+    BEFORE INSERT ON Waiters
+BEGIN
+    SELECT
+    CASE
+    WHEN NEW.FullAge < 18 THEN
+        RAISE (ABORT,'This waiter can not be added because of an age restriction')
+    END;
+END;
+)";
+
+// Columns the original ctor.sql declared but the shipped database never got,
+// StoredProcedures::IngredientsCheaperThan relies on PricePerUnit
+static constexpr const char MissingColumns[] = R"(
+ALTER TABLE Addresses ADD COLUMN Street varchar(64);
+ALTER TABLE Ingredients ADD COLUMN PricePerUnit float NOT NULL DEFAULT 0;
+)";
+
+// One index per lookup the mediators and stored procedures do and per foreign
+// key. Link tables get covering indexes, their rows are never read otherwise
+static constexpr const char LookupIndexes[] = R"(
+CREATE INDEX IF NOT EXISTS DrinksByName ON Drinks(Name);
+CREATE INDEX IF NOT EXISTS GobletsByName ON Goblets(Name);
+CREATE INDEX IF NOT EXISTS GobletsByCapacity ON Goblets(Capacity);
+CREATE INDEX IF NOT EXISTS WaitersByShortName ON Waiters(ShortName);
+CREATE INDEX IF NOT EXISTS WaitersBySalary ON Waiters(Salary);
+CREATE INDEX IF NOT EXISTS IngredientsByName ON Ingredients(Name);
+CREATE INDEX IF NOT EXISTS IngredientsByPrice ON Ingredients(PricePerUnit);
+CREATE INDEX IF NOT EXISTS IngredientsBySource ON Ingredients(SourceID);
+CREATE INDEX IF NOT EXISTS SourcesByAddress ON Sources(AddressID);
+CREATE INDEX IF NOT EXISTS AddressesByLocation ON Addresses(City, House, PostalCode);
+
+CREATE INDEX IF NOT EXISTS OrdersLogByDate ON OrdersLog(OrderDate, WaiterID);
+CREATE INDEX IF NOT EXISTS OrdersLogByWaiter ON OrdersLog(WaiterID);
+
+CREATE INDEX IF NOT EXISTS DrinkOrdersByOrder ON DrinkOrders(OrderID, DrinkID, GobletID);
+CREATE INDEX IF NOT EXISTS DrinkOrdersByDrink ON DrinkOrders(DrinkID);
+CREATE INDEX IF NOT EXISTS DrinkOrdersByGoblet ON DrinkOrders(GobletID);
+
+CREATE INDEX IF NOT EXISTS IngredientsDrinksByDrink ON IngredientsDrinks(DrinkID, IngredientID, UnitsCount);
+CREATE INDEX IF NOT EXISTS IngredientsDrinksByIngredient ON IngredientsDrinks(IngredientID, DrinkID);
+
+DROP VIEW IF EXISTS OrdersWithNameAndCount;
+CREATE VIEW OrdersWithNameAndCount AS
+    SELECT OrdersLog.ID, CustomerShortName AS CustomerName, Tips, Waiters.ShortName AS WaiterName,
+    (SELECT count(*) FROM DrinkOrders WHERE OrderID == +OrdersLog.ID) AS DrinksCount
+    FROM OrdersLog JOIN Waiters on Waiters.ID = OrdersLog.WaiterID;
+
+DROP VIEW IF EXISTS DrinksWithIngredientsCount;
+CREATE VIEW DrinksWithIngredientsCount AS
+    SELECT *, (SELECT count(*) FROM IngredientsDrinks WHERE DrinkID == +Drinks.ID) AS IngredientsCount
+    FROM Drinks;
+)";
+
+// 'int PRIMARY KEY' is a unique index beside the rowid, the tables are rebuilt
+// with the ID as the rowid itself. AUTOINCREMENT keeps the ids of deleted rows
+// from being handed out again and is what ReserveIDs() claims blocks from.
+// Indexes, views and triggers go away with the old tables
+static constexpr const char RowIDKeys[] = R"(
+DROP VIEW IF EXISTS OrdersWithNameAndCount;
+DROP VIEW IF EXISTS DrinksWithIngredientsCount;
+
+CREATE TABLE NewAddresses(
+    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+    City varchar(64),
+    House varchar(2),
+    PostalCode int,
+    Street varchar(64)
+);
+INSERT INTO NewAddresses SELECT ID, City, House, PostalCode, Street FROM Addresses;
+DROP TABLE Addresses;
+ALTER TABLE NewAddresses RENAME TO Addresses;
+
+CREATE TABLE NewSources(
+    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+    Name varchar(64),
+    AddressID REFERENCES Addresses(ID)
+);
+INSERT INTO NewSources SELECT ID, Name, AddressID FROM Sources;
+DROP TABLE Sources;
+ALTER TABLE NewSources RENAME TO Sources;
+
+CREATE TABLE NewIngredients(
+    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+    Name varchar(64) NOT NULL,
+    Units varchar(64) NOT NULL,
+    SourceID REFERENCES Sources(ID),
+    PricePerUnit float NOT NULL DEFAULT 0
+);
+INSERT INTO NewIngredients SELECT ID, Name, Units, SourceID, PricePerUnit FROM Ingredients;
+DROP TABLE Ingredients;
+ALTER TABLE NewIngredients RENAME TO Ingredients;
+
+CREATE TABLE NewDrinks(
+    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+    Name varchar(64),
+    PricePerLiter float,
+    AgeRestriction int
+);
+INSERT INTO NewDrinks SELECT ID, Name, PricePerLiter, AgeRestriction FROM Drinks;
+DROP TABLE Drinks;
+ALTER TABLE NewDrinks RENAME TO Drinks;
+
+CREATE TABLE NewWaiters(
+    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+    ShortName varchar(64),
+    Salary float,
+    FullAge int
+);
+INSERT INTO NewWaiters SELECT ID, ShortName, Salary, FullAge FROM Waiters;
+DROP TABLE Waiters;
+ALTER TABLE NewWaiters RENAME TO Waiters;
+
+CREATE TABLE NewGoblets(
+    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+    Name varchar(64),
+    Capacity float
+);
+INSERT INTO NewGoblets SELECT ID, Name, Capacity FROM Goblets;
+DROP TABLE Goblets;
+ALTER TABLE NewGoblets RENAME TO Goblets;
+
+CREATE TABLE NewOrdersLog(
+    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+    CustomerShortName varchar(64),
+    Tips float,
+    WaiterID REFERENCES Waiters(ID),
+    Checkout float,
+    OrderDate date
+);
+INSERT INTO NewOrdersLog SELECT ID, CustomerShortName, Tips, WaiterID, Checkout, OrderDate FROM OrdersLog;
+DROP TABLE OrdersLog;
+ALTER TABLE NewOrdersLog RENAME TO OrdersLog;
+
+CREATE TRIGGER ValidateWaiterAge
+    BEFORE INSERT ON Waiters
+BEGIN
+    SELECT
+    CASE
+    WHEN NEW.FullAge < 18 THEN
+        RAISE (ABORT,'This waiter can not be added because of an age restriction')
+    END;
+END;
+)";
+
+static constexpr Migration BreweryMigrations[] = {
+    {1, "baseline schema", BaselineSchema},
+    {2, "missing ctor.sql columns", MissingColumns},
+    {3, "lookup indexes", LookupIndexes},
+    {4, "rowid primary keys", RowIDKeys},
+    // Recreates what went away with the rebuilt tables
+    {5, "lookup indexes of the rebuilt tables", LookupIndexes},
+};
+
+// Brings the database up to the latest schema and checks that the planner
+// picks the lookup indexes for the statements they were made for
+class SchemaMigrator{
+private:
+    struct ExpectedPlan{
+        const char *Sql;
+        const char *Index;
+    };
+
+    static constexpr ExpectedPlan ExpectedPlans[] = {
+        {SelectByStatement<&DrinkRow::Name>::Text.Data,                 "DrinksByName"},
+        {SelectByStatement<&GobletRow::Name>::Text.Data,                "GobletsByName"},
+        {SelectByStatement<&WaiterRow::ShortName>::Text.Data,           "WaitersByShortName"},
+        {SelectByStatement<&DrinkOrderRow::OrderID>::Text.Data,         "DrinkOrdersByOrder"},
+        {SelectByStatement<&IngredientDrinkRow::DrinkID>::Text.Data,    "IngredientsDrinksByDrink"},
+        {OrdersLogTableMediator::SelectBetween.Data,                    "OrdersLogByDate"},
+        {AddressesTableMediator::SelectByLocation.Data,                 "AddressesByLocation"},
+        {StoredProcedures::SourcesWithCity.Data,                        "SourcesByAddress"},
+        {StoredProcedures::ExpensiveWaiters.Data,                       "WaitersBySalary"},
+        {StoredProcedures::DrinksWith.Data,                             "IngredientsByName"},
+        {StoredProcedures::DrinksWith.Data,                             "IngredientsDrinksByIngredient"},
+        {StoredProcedures::IngredientsCheaperThan.Data,                 "IngredientsByPrice"},
+        {StoredProcedures::GobletsLargerThan.Data,                      "GobletsByCapacity"},
+        {StoredProcedures::OrdersCountByWaiter,                         "OrdersLogByDate"},
+        {StoredProcedures::DrinksSoldCount,                             "DrinkOrdersByOrder"},
+        {"SELECT * FROM OrdersWithNameAndCount",                        "DrinkOrdersByOrder"},
+        {"SELECT * FROM DrinksWithIngredientsCount",                    "IngredientsDrinksByDrink"},
+    };
+
+    bool m_IsMigrated = false;
+    bool m_IsVerified = false;
+public:
+    SchemaMigrator(Database &db, DatabaseLogger &logger){
+        if(db.IsReadOnly())
+            return;
+
+        m_IsMigrated = db.Migrate(BreweryMigrations);
+        if(!m_IsMigrated){
+            logger.Log("[Schema]: database is left at version %", db.UserVersion());
+            return;
+        }
+        RestoreLookupIndexes(db, logger);
+        m_IsVerified = Verify(db, logger);
+    }
+
+    bool IsMigrated()const{
+        return m_IsMigrated;
+    }
+
+    // False when some lookup does not use the index made for it
+    bool IsVerified()const{
+        return m_IsVerified;
+    }
+
+    static constexpr int LatestVersion(){
+        return BreweryMigrations[std::size(BreweryMigrations) - 1].Version;
+    }
+private:
+    // Bulk imports drop the indexes of the table they fill until they are done,
+    // an import that never got to the end leaves them missing at any version
+    static void RestoreLookupIndexes(Database &db, DatabaseLogger &logger){
+        static constexpr std::string_view Prefix = "CREATE INDEX IF NOT EXISTS ";
+
+        const std::string_view script = LookupIndexes;
+        for(size_t begin = script.find(Prefix); begin != std::string_view::npos; begin = script.find(Prefix, begin + 1)){
+            const size_t name_begin = begin + Prefix.size();
+            const std::string name(script.substr(name_begin, script.find(' ', name_begin) - name_begin));
+            if(db.Query("SELECT 1 FROM sqlite_master WHERE type = 'index' AND name = ?", name.c_str()))
+                continue;
+
+            const std::string sql(script.substr(begin, script.find(';', begin) - begin));
+            logger.Log("[Schema]: index % is missing, rebuilding it", name.c_str());
+            db.Execute(sql.c_str());
+        }
+    }
+
+    static bool Verify(Database &db, DatabaseLogger &logger){
+        bool is_verified = true;
+        for(const ExpectedPlan &expected: ExpectedPlans){
+            const std::string plan = db.ExplainQueryPlan(expected.Sql);
+            if(UsesIndex(plan, expected.Index))
+                continue;
+
+            logger.Log("[Schema]: '%' does not use index %, plan:\n%", expected.Sql, expected.Index, plan.c_str());
+            is_verified = false;
+        }
+        return is_verified;
+    }
+
+    static bool UsesIndex(const std::string &plan, const char *index){
+        const std::string needle = std::string("INDEX ") + index;
+        for(size_t position = plan.find(needle); position != std::string::npos; position = plan.find(needle, position + 1)){
+            const size_t end = position + needle.size();
+            if(end == plan.size() || plan[end] == ' ' || plan[end] == '\n')
+                return true;
+        }
+        return false;
+    }
+};
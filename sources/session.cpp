@@ -0,0 +1,324 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Runs the SQL typed into the console on a connection and thread of its own,
+// so a runaway statement never stalls the frame. The progress handler of the
+// connection counts the work done and aborts a statement once it is cancelled
+// or out of its time budget. Rows come back a page at a time, the cursor stays
+// open on the worker until the last page is fetched or the next statement runs.
+class ConsoleSession{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto DefaultTimeBudget = std::chrono::seconds(30);
+    // Virtual machine instructions between two calls of the progress handler
+    static constexpr int ProgressPeriod = 1000;
+    static constexpr size_t PageSize = PagedResult::DefaultPageSize;
+    static constexpr size_t DefaultBenchWarmup = 10;
+
+    // What a statement or a page fetch came back with
+    struct Outcome{
+        MaterializedResult Page;
+        bool IsFirstPage = false;
+        bool IsComplete = true;
+        int Changes = 0;
+        std::string Error;
+        // Time the statement spent running, over all of its pages so far
+        Clock::duration Elapsed{};
+    };
+private:
+    enum class Request{
+        None,
+        Run,
+        Fetch,
+        Close,
+        Bench
+    };
+
+    DatabaseLogger m_Logger;
+    Database m_Database;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Signal;
+    Request m_Request = Request::None;
+    std::string m_Sql;
+    size_t m_BenchIterations = 0;
+    size_t m_BenchWarmup = 0;
+    std::optional<Outcome> m_Outcome;
+    bool m_IsRunning = true;
+
+    std::atomic<bool> m_IsBusy{false};
+    std::atomic<bool> m_IsCancelled{false};
+    std::atomic<uint64_t> m_Progress{0};
+    std::atomic<Clock::rep> m_TimeBudget{std::chrono::duration_cast<Clock::duration>(DefaultTimeBudget).count()};
+    Clock::time_point m_RequestTime;
+
+    // Owned by the worker
+    std::optional<QueryResult> m_Cursor;
+    Clock::duration m_Spent{};
+    Clock::time_point m_Deadline;
+    bool m_IsOverBudget = false;
+
+    std::thread m_Worker;
+public:
+    ConsoleSession(const char *database_path):
+        m_Database(database_path, m_Logger, SQLITE_OPEN_READWRITE),
+        m_Worker(&ConsoleSession::WorkerMain, this)
+    {}
+
+    ConsoleSession(const ConsoleSession &) = delete;
+
+    ConsoleSession &operator=(const ConsoleSession &) = delete;
+
+    ~ConsoleSession(){
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_IsRunning = false;
+        }
+        Cancel();
+        m_Signal.notify_one();
+        m_Worker.join();
+    }
+
+    // False while the previous request is still running
+    bool Run(const char *sql){
+        return Submit(Request::Run, sql);
+    }
+
+    // Asks for the next page of the last statement's rows
+    bool FetchPage(){
+        return Submit(Request::Fetch, "");
+    }
+
+    // Runs 'sql' to its last row 'warmup' times untimed, then 'iterations'
+    // times timed, the latencies come back as a one row result
+    bool Bench(const char *sql, size_t iterations, size_t warmup = DefaultBenchWarmup){
+        return Submit(Request::Bench, sql, iterations, warmup);
+    }
+
+    // Lets go of the rows not fetched yet, and of the read snapshot they hold
+    bool Close(){
+        return Submit(Request::Close, "");
+    }
+
+    void Cancel(){
+        m_IsCancelled = true;
+        // An idle connection may still have a cursor open, an interrupt would hit its next page
+        if(IsBusy())
+            m_Database.Interrupt();
+    }
+
+    bool IsBusy()const{
+        return m_IsBusy.load(std::memory_order_acquire);
+    }
+
+    // The outcome of the last request once it is done, only handed out once
+    std::optional<Outcome> Poll(){
+        std::lock_guard<std::mutex> lock(m_Lock);
+        std::optional<Outcome> outcome = Move(m_Outcome);
+        m_Outcome.reset();
+        return outcome;
+    }
+
+    // Virtual machine instructions the statement ran so far, roughly
+    uint64_t Progress()const{
+        return m_Progress.load(std::memory_order_relaxed);
+    }
+
+    Clock::duration RunningFor()const{
+        return Clock::now() - m_RequestTime;
+    }
+
+    // Zero lets statements run for as long as they take
+    void SetTimeBudget(Clock::duration budget){
+        m_TimeBudget.store(budget.count(), std::memory_order_relaxed);
+    }
+
+    Clock::duration TimeBudget()const{
+        return Clock::duration(m_TimeBudget.load(std::memory_order_relaxed));
+    }
+private:
+    bool Submit(Request request, const char *sql, size_t iterations = 0, size_t warmup = 0){
+        if(IsBusy())
+            return false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Request = request;
+            m_Sql = sql;
+            m_BenchIterations = iterations;
+            m_BenchWarmup = warmup;
+            m_IsBusy = true;
+            m_IsCancelled = false;
+            if(request == Request::Run || request == Request::Bench)
+                m_Progress = 0;
+        }
+        m_RequestTime = Clock::now();
+        m_Signal.notify_one();
+        return true;
+    }
+
+    void WorkerMain(){
+        m_Database.SetProgressHandler(ProgressPeriod, &ConsoleSession::OnProgress, this);
+
+        std::unique_lock<std::mutex> lock(m_Lock);
+        for(;;){
+            m_Signal.wait(lock, [this](){ return !m_IsRunning || m_Request != Request::None; });
+            if(!m_IsRunning)
+                break;
+
+            const Request request = m_Request;
+            const std::string sql = Move(m_Sql);
+            const size_t iterations = m_BenchIterations;
+            const size_t warmup = m_BenchWarmup;
+            m_Request = Request::None;
+            lock.unlock();
+
+            Outcome outcome;
+            if(request == Request::Run)
+                outcome = Execute(sql.c_str());
+            if(request == Request::Fetch)
+                outcome = Fetch();
+            if(request == Request::Close)
+                m_Cursor.reset();
+            if(request == Request::Bench)
+                outcome = Measure(sql.c_str(), iterations, warmup);
+
+            lock.lock();
+            m_Outcome = Move(outcome);
+            m_IsBusy.store(false, std::memory_order_release);
+        }
+        m_Cursor.reset();
+    }
+
+    Outcome Execute(const char *sql){
+        m_Cursor.reset();
+        m_Spent = {};
+        m_Logger.Clear();
+
+        const Clock::time_point begin = Start();
+        const int changes = m_Database.TotalChanges();
+
+        Outcome outcome;
+        outcome.IsFirstPage = true;
+
+        QueryResult query = m_Database.Query(sql);
+        outcome.Page = query.Materialize(PageSize);
+        outcome.Changes = m_Database.TotalChanges() - changes;
+        if(query)
+            m_Cursor.emplace(Move(query));
+
+        return Finish(Move(outcome), begin);
+    }
+
+    Outcome Measure(const char *sql, size_t iterations, size_t warmup){
+        m_Cursor.reset();
+        m_Spent = {};
+        m_Logger.Clear();
+
+        const Clock::time_point begin = Start();
+
+        Outcome outcome;
+        outcome.IsFirstPage = true;
+
+        std::vector<int64_t> samples;
+        samples.reserve(iterations);
+        uint64_t rows = 0;
+        for(size_t i = 0; i < warmup + iterations && !m_Logger.Size(); i++){
+            const Clock::time_point start = Clock::now();
+            uint64_t query_rows = 0;
+            {
+                QueryResult query = m_Database.Query(sql);
+                for(; query; query.Next())
+                    query_rows++;
+            }
+            if(i < warmup)
+                continue;
+
+            samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+            rows += query_rows;
+        }
+
+        if(!m_Logger.Size())
+            outcome.Page = Report(samples, rows);
+        return Finish(Move(outcome), begin);
+    }
+
+    MaterializedResult Report(std::vector<int64_t> &samples, uint64_t rows){
+        std::sort(samples.begin(), samples.end());
+
+        auto percentile = [&](double p){
+            return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))] / 1e6;
+        };
+        int64_t total_ns = 0;
+        for(int64_t sample: samples)
+            total_ns += sample;
+        const double seconds = total_ns / 1e9;
+
+        return m_Database.Query(
+            "SELECT ? AS runs, ? AS rows, round(?, 3) AS min_ms, round(?, 3) AS median_ms, round(?, 3) AS p95_ms, round(?, 3) AS p99_ms, round(?, 3) AS max_ms, ? AS rows_per_s",
+            (sqlite3_int64)samples.size(), (sqlite3_int64)rows, samples.front() / 1e6, percentile(0.50), percentile(0.95), percentile(0.99), samples.back() / 1e6,
+            (sqlite3_int64)(seconds > 0 ? rows / seconds : 0)
+        ).Materialize();
+    }
+
+    Outcome Fetch(){
+        Outcome outcome;
+        if(!m_Cursor)
+            return outcome;
+        m_Logger.Clear();
+
+        const Clock::time_point begin = Start();
+        outcome.Page = m_Cursor->Materialize(PageSize);
+        if(!*m_Cursor)
+            m_Cursor.reset();
+
+        return Finish(Move(outcome), begin);
+    }
+
+    Clock::time_point Start(){
+        const Clock::time_point now = Clock::now();
+        const Clock::duration budget = TimeBudget();
+
+        m_IsOverBudget = false;
+        m_Deadline = budget.count() ? now + budget - m_Spent : Clock::time_point::max();
+        return now;
+    }
+
+    Outcome Finish(Outcome outcome, Clock::time_point begin){
+        m_Spent += Clock::now() - begin;
+        outcome.Elapsed = m_Spent;
+
+        if(m_Logger.Size()){
+            if(m_IsCancelled)
+                outcome.Error = "cancelled";
+            else if(m_IsOverBudget)
+                outcome.Error = StringPrint("over the time budget of % ms", std::chrono::duration_cast<std::chrono::milliseconds>(TimeBudget()).count()).Data();
+            else
+                outcome.Error = m_Logger.Last();
+            m_Cursor.reset();
+        }
+        outcome.IsComplete = !m_Cursor;
+        return outcome;
+    }
+
+    static int OnProgress(void *user){
+        ConsoleSession *self = (ConsoleSession *)user;
+        self->m_Progress.fetch_add(ProgressPeriod, std::memory_order_relaxed);
+
+        if(self->m_IsCancelled.load(std::memory_order_relaxed))
+            return 1;
+        if(Clock::now() > self->m_Deadline){
+            self->m_IsOverBudget = true;
+            return 1;
+        }
+        return 0;
+    }
+};
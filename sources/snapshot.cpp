@@ -0,0 +1,356 @@
+#include <deque>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <tuple>
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+// Every distinct string is stored once and columns keep 32-bit codes, code 0 is NULL.
+// Strings are never dropped, so codes and pointers stay valid for the dictionary's lifetime.
+class StringDictionary{
+private:
+    std::deque<std::string> m_Strings;
+    std::unordered_map<std::string_view, uint32_t> m_Codes;
+    // Codes in text order, strings encoded since the last range lookup are merged in by the next one
+    mutable std::vector<uint32_t> m_Sorted;
+public:
+    static constexpr uint32_t Null = 0;
+
+    uint32_t Encode(const char *string){
+        if(!string)
+            return Null;
+
+        auto it = m_Codes.find(string);
+        if(it != m_Codes.end())
+            return it->second;
+
+        m_Strings.emplace_back(string);
+        const uint32_t code = m_Strings.size();
+        m_Codes.emplace(m_Strings.back(), code);
+        return code;
+    }
+
+    const char *Decode(uint32_t code)const{
+        return code == Null ? nullptr : m_Strings[code - 1].c_str();
+    }
+
+    // Codes run from 1 to Size() inclusive
+    size_t Size()const{
+        return m_Strings.size();
+    }
+
+    // Calls 'function(code)' for every string from 'first' to 'last' inclusive, compared as text
+    template<typename FunctionType>
+    void ForEachBetween(const char *first, const char *last, FunctionType function)const{
+        Sort();
+
+        auto less = [this](uint32_t code, const char *string){ return strcmp(Decode(code), string) < 0; };
+        auto greater = [this](const char *string, uint32_t code){ return strcmp(string, Decode(code)) < 0; };
+        auto begin = std::lower_bound(m_Sorted.begin(), m_Sorted.end(), first, less);
+        auto end = std::upper_bound(begin, m_Sorted.end(), last, greater);
+        for(; begin < end; ++begin)
+            function(*begin);
+    }
+private:
+    void Sort()const{
+        const size_t sorted = m_Sorted.size();
+        if(sorted == m_Strings.size())
+            return;
+
+        for(uint32_t code = sorted + 1; code <= m_Strings.size(); code++)
+            m_Sorted.push_back(code);
+
+        auto less = [this](uint32_t left, uint32_t right){ return m_Strings[left - 1] < m_Strings[right - 1]; };
+        std::sort(m_Sorted.begin() + sorted, m_Sorted.end(), less);
+        std::inplace_merge(m_Sorted.begin(), m_Sorted.begin() + sorted, m_Sorted.end(), less);
+    }
+};
+
+template<typename Type>
+struct ColumnStorage{
+    using Element = Type;
+};
+
+template<>
+struct ColumnStorage<const char *>{
+    using Element = uint32_t;
+};
+
+template<typename RowType>
+constexpr SqlText SelectWithRowID(const char *condition = ""){
+    using Schema = TableSchema<RowType>;
+
+    SqlText sql;
+    sql.Append("SELECT ");
+    for(size_t i = 0; i < std::size(Schema::ColumnNames); i++)
+        sql.Append(Schema::ColumnNames[i]).Append(", ");
+    sql.Append("rowid FROM ").Append(Schema::Name).Append(condition);
+    return sql;
+}
+
+// One contiguous array per column of the table, in no particular row order.
+// String columns hold dictionary codes.
+template<typename RowType>
+class ColumnarTable{
+public:
+    using Schema = TableSchema<RowType>;
+private:
+    template<typename ColumnsType>
+    struct Storage;
+
+    template<auto ...Members>
+    struct Storage<ColumnList<Members...>>{
+        using Type = std::tuple<std::vector<typename ColumnStorage<typename MemberTraits<decltype(Members)>::Type>::Element>...>;
+    };
+
+    static constexpr size_t ColumnsCount = std::size(Schema::ColumnNames);
+
+    static constexpr SqlText SelectAll = SelectWithRowID<RowType>();
+    static constexpr SqlText SelectOne = SelectWithRowID<RowType>(" WHERE rowid = ?");
+
+    // String columns share one dictionary unless given their own
+    std::array<StringDictionary *, ColumnsCount> m_Dictionaries;
+    typename Storage<typename Schema::Columns>::Type m_Columns;
+    std::vector<sqlite3_int64> m_RowIDs;
+    std::unordered_map<sqlite3_int64, size_t> m_Index;
+
+    QueryExecutor::Future m_Loading;
+public:
+    ColumnarTable(StringDictionary &strings){
+        m_Dictionaries.fill(&strings);
+    }
+
+    // Only before the first load
+    template<auto Member>
+    void SetDictionary(StringDictionary &strings){
+        constexpr size_t index = ColumnIndex<Member>(typename Schema::Columns());
+        static_assert(index < ColumnsCount, "Member is not a column of the table");
+        m_Dictionaries[index] = &strings;
+    }
+
+    template<auto Member>
+    const auto &Column()const{
+        constexpr size_t index = ColumnIndex<Member>(typename Schema::Columns());
+        static_assert(index < ColumnsCount, "Member is not a column of the table");
+        return std::get<index>(m_Columns);
+    }
+
+    size_t Size()const{
+        return m_RowIDs.size();
+    }
+
+    void RequestLoad(QueryExecutor &executor){
+        m_Loading = executor.Submit([](Database &db){
+            return db.Query(SelectAll.Data).Materialize();
+        });
+    }
+
+    // True once the requested load has landed
+    bool FinishLoad(){
+        if(!m_Loading.IsValid())
+            return true;
+        if(!m_Loading.IsReady())
+            return false;
+
+        const MaterializedResult &result = m_Loading.Result();
+        Clear();
+        Reserve(result.RowCount());
+        for(size_t i = 0; i < result.RowCount(); i++){
+            auto row = result.RowAt(i);
+            Upsert(row.GetColumnInt64(ColumnsCount), row);
+        }
+        m_Loading = {};
+        return true;
+    }
+
+    // Changes are hints, the row is read back to learn whether it still exists
+    void Apply(Database &db, const RowChange &change){
+        if(change.Operation == RowChange::Delete){
+            Erase(change.RowID);
+            return;
+        }
+
+        auto query = db.Query(SelectOne.Data, change.RowID);
+        if(query)
+            Upsert(change.RowID, query);
+        else
+            Erase(change.RowID);
+    }
+private:
+    void Clear(){
+        std::apply([](auto &...columns){ (columns.clear(), ...); }, m_Columns);
+        m_RowIDs.clear();
+        m_Index.clear();
+    }
+
+    void Reserve(size_t count){
+        std::apply([count](auto &...columns){ (columns.reserve(count), ...); }, m_Columns);
+        m_RowIDs.reserve(count);
+        m_Index.reserve(count);
+    }
+
+    template<typename SourceType>
+    void Upsert(sqlite3_int64 rowid, const SourceType &source){
+        auto it = m_Index.find(rowid);
+        const bool is_new = it == m_Index.end();
+        const size_t index = is_new ? m_RowIDs.size() : it->second;
+
+        if(is_new){
+            m_Index.emplace(rowid, index);
+            m_RowIDs.push_back(rowid);
+        }
+        Store(index, is_new, source, typename Schema::Columns(), std::make_index_sequence<ColumnsCount>());
+    }
+
+    template<typename SourceType, auto ...Members, size_t ...Index>
+    void Store(size_t row, bool is_new, const SourceType &source, ColumnList<Members...>, std::index_sequence<Index...>){
+        (Store(std::get<Index>(m_Columns), *m_Dictionaries[Index], row, is_new, Extracter<typename MemberTraits<decltype(Members)>::Type, Index>::Extract(source)), ...);
+    }
+
+    template<typename ElementType, typename ValueType>
+    void Store(std::vector<ElementType> &column, StringDictionary &strings, size_t row, bool is_new, ValueType value){
+        ElementType element;
+        if constexpr(std::is_same_v<ValueType, const char *>)
+            element = strings.Encode(value);
+        else
+            element = value;
+
+        if(is_new)
+            column.push_back(element);
+        else
+            column[row] = element;
+    }
+
+    // The last row takes the place of the erased one
+    void Erase(sqlite3_int64 rowid){
+        auto it = m_Index.find(rowid);
+        if(it == m_Index.end())
+            return;
+
+        const size_t index = it->second;
+        const size_t last = m_RowIDs.size() - 1;
+        m_Index.erase(it);
+
+        std::apply([index, last](auto &...columns){ ((columns[index] = columns[last], columns.pop_back()), ...); }, m_Columns);
+        m_RowIDs[index] = m_RowIDs[last];
+        m_RowIDs.pop_back();
+
+        if(index != last)
+            m_Index[m_RowIDs[index]] = index;
+    }
+};
+
+// Columnar copy of the tables behind orders analytics. The first load runs on
+// the reader pool, afterwards only the rows reported by the change stream are
+// read back, on the thread that calls Update().
+class BrewerySnapshot{
+private:
+    Database &m_Database;
+    QueryExecutor &m_Executor;
+    std::shared_ptr<ChangeSubscription> m_Changes;
+
+    StringDictionary m_Strings;
+    // Apart from the names, so a date range only searches the dates
+    StringDictionary m_Dates;
+    ColumnarTable<OrderRow> m_Orders{m_Strings};
+    ColumnarTable<DrinkOrderRow> m_DrinkOrders{m_Strings};
+    ColumnarTable<DrinkRow> m_Drinks{m_Strings};
+    ColumnarTable<GobletRow> m_Goblets{m_Strings};
+    ColumnarTable<WaiterRow> m_Waiters{m_Strings};
+
+    bool m_IsLoaded = false;
+    uint64_t m_Version = 0;
+public:
+    BrewerySnapshot(Database &db, QueryExecutor &executor):
+        m_Database(db),
+        m_Executor(executor),
+        m_Changes(db.SubscribeChanges())
+    {
+        m_Orders.SetDictionary<&OrderRow::OrderDate>(m_Dates);
+        Reload();
+    }
+
+    // Call once per frame, changes are only buffered in between
+    void Update(){
+        if(!m_IsLoaded){
+            bool is_loaded = true;
+            ForEachTable([&](auto &table){ is_loaded &= table.FinishLoad(); });
+            if(!is_loaded)
+                return;
+
+            m_IsLoaded = true;
+            m_Version++;
+        }
+
+        // Rows re-read below are current, so changes that the load already saw are harmless
+        if(m_Changes->ConsumeOverflow())
+            return Reload();
+
+        bool is_changed = false;
+        RowChange change;
+        while(m_Changes->Poll(change)){
+            ForEachTable([&](auto &table){
+                if(!change.IsOn(std::decay_t<decltype(table)>::Schema::Name))
+                    return;
+                table.Apply(m_Database, change);
+                is_changed = true;
+            });
+        }
+        m_Version += is_changed;
+    }
+
+    bool IsLoaded()const{
+        return m_IsLoaded;
+    }
+
+    // Bumped whenever the contents change
+    uint64_t Version()const{
+        return m_Version;
+    }
+
+    const StringDictionary &Strings()const{
+        return m_Strings;
+    }
+
+    // Codes of OrderRow::OrderDate
+    const StringDictionary &Dates()const{
+        return m_Dates;
+    }
+
+    const ColumnarTable<OrderRow> &Orders()const{
+        return m_Orders;
+    }
+
+    const ColumnarTable<DrinkOrderRow> &DrinkOrders()const{
+        return m_DrinkOrders;
+    }
+
+    const ColumnarTable<DrinkRow> &Drinks()const{
+        return m_Drinks;
+    }
+
+    const ColumnarTable<GobletRow> &Goblets()const{
+        return m_Goblets;
+    }
+
+    const ColumnarTable<WaiterRow> &Waiters()const{
+        return m_Waiters;
+    }
+private:
+    void Reload(){
+        m_IsLoaded = false;
+        ForEachTable([this](auto &table){ table.RequestLoad(m_Executor); });
+    }
+
+    template<typename FunctionType>
+    void ForEachTable(FunctionType function){
+        function(m_Orders);
+        function(m_DrinkOrders);
+        function(m_Drinks);
+        function(m_Goblets);
+        function(m_Waiters);
+    }
+};
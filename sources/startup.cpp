@@ -0,0 +1,76 @@
+#include <core/print.hpp>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+// Spans of the work done between launch and the application being ready,
+// recorded from any thread and printed once everything is in
+class StartupTimeline{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Span{
+        const char *Name;
+        Clock::time_point Begin;
+        Clock::time_point End;
+        bool IsMainThread;
+    };
+private:
+    const Clock::time_point m_Start = Clock::now();
+    const std::thread::id m_MainThread = std::this_thread::get_id();
+    std::mutex m_Lock;
+    std::vector<Span> m_Spans;
+    bool m_IsPrinted = false;
+public:
+    StartupTimeline() = default;
+
+    StartupTimeline(const StartupTimeline &) = delete;
+
+    StartupTimeline &operator=(const StartupTimeline &) = delete;
+
+    Clock::time_point Start()const{
+        return m_Start;
+    }
+
+    void Add(const char *name, Clock::time_point begin, Clock::time_point end = Clock::now()){
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Spans.push_back({name, begin, end, std::this_thread::get_id() == m_MainThread});
+    }
+
+    template<typename FunctionType>
+    void Measure(const char *name, FunctionType function){
+        const auto begin = Clock::now();
+        function();
+        Add(name, begin);
+    }
+
+    bool IsPrinted()const{
+        return m_IsPrinted;
+    }
+
+    // Prints the spans in order of their start to stdout and to the logger
+    void Print(DatabaseLogger &logger){
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_IsPrinted = true;
+
+        std::vector<Span> spans = m_Spans;
+        std::sort(spans.begin(), spans.end(), [](const Span &left, const Span &right){
+            return left.Begin < right.Begin;
+        });
+
+        for(const Span &span: spans){
+            char line[128];
+            std::snprintf(line, sizeof(line), "%8.1f ..%8.1f ms  %-6s %s",
+                Milliseconds(span.Begin), Milliseconds(span.End), span.IsMainThread ? "main" : "worker", span.Name);
+            Println("[Startup]: %", line);
+            logger.Log("[Startup]: %", line);
+        }
+    }
+private:
+    double Milliseconds(Clock::time_point point)const{
+        return std::chrono::duration<double, std::milli>(point - m_Start).count();
+    }
+};
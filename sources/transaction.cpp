@@ -0,0 +1,184 @@
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+// Scoped write transaction, rolled back unless committed. Opened inside
+// another transaction it becomes a savepoint, so it can be undone alone.
+class Transaction{
+private:
+    Database &m_Database;
+    bool m_IsNested = false;
+    bool m_IsActive = false;
+public:
+    Transaction(Database &db):
+        m_Database(db),
+        m_IsNested(db.IsInTransaction())
+    {
+        // IMMEDIATE takes the write lock upfront, a deferred transaction that
+        // upgrades later can fail with SQLITE_BUSY halfway through in WAL mode
+        m_IsActive = m_Database.Execute(m_IsNested ? "SAVEPOINT Nested" : "BEGIN IMMEDIATE");
+    }
+
+    Transaction(const Transaction &) = delete;
+
+    Transaction &operator=(const Transaction &) = delete;
+
+    ~Transaction(){
+        Rollback();
+    }
+
+    bool Commit(){
+        if(!m_IsActive)
+            return false;
+
+        if(m_Database.Execute(m_IsNested ? "RELEASE Nested" : "COMMIT")){
+            m_IsActive = false;
+            return true;
+        }
+        // A failed commit leaves the transaction open
+        Rollback();
+        return false;
+    }
+
+    void Rollback(){
+        if(!m_IsActive)
+            return;
+
+        m_IsActive = false;
+        if(m_IsNested){
+            m_Database.Execute("ROLLBACK TO Nested");
+            m_Database.Execute("RELEASE Nested");
+            m_Database.OnSavepointRollback();
+        }else if(m_Database.IsInTransaction()){
+            // An interrupt or a full disk may have rolled it back already
+            m_Database.Execute("ROLLBACK");
+        }
+    }
+
+    bool IsActive()const{
+        return m_IsActive;
+    }
+};
+
+// Coalesces writes submitted within a short window into one transaction, so
+// a burst of inserts pays for one commit and one sync instead of one each.
+// Writes may be submitted from any thread, but they run on the thread that
+// calls Pump(), the one that owns the connection.
+class GroupCommitQueue{
+public:
+    // A write returns false to have its own changes rolled back, the rest of the batch still commits
+    using WriteType = std::function<bool(Database &)>;
+    // Runs on the thread that called Pump(), once the write's batch committed
+    using CommittedType = std::function<void()>;
+
+    static constexpr auto DefaultWindow = std::chrono::milliseconds(4);
+    static constexpr size_t DefaultBatchSize = 512;
+
+    struct Stats{
+        size_t Commits = 0;
+        // Writes that made it into a commit
+        size_t Writes = 0;
+        size_t FailedWrites = 0;
+    };
+private:
+    struct PendingWrite{
+        WriteType Write;
+        CommittedType OnCommitted;
+    };
+
+    Database &m_Database;
+    std::chrono::steady_clock::duration m_Window;
+    size_t m_BatchSize;
+
+    std::mutex m_Lock;
+    std::vector<PendingWrite> m_Pending;
+    std::chrono::steady_clock::time_point m_FirstPendingTime;
+
+    std::vector<PendingWrite> m_Batch;
+    std::vector<CommittedType> m_Committed;
+    Stats m_Stats;
+public:
+    // How durable the commits are is up to the owner of the connection, see Database::SetDurability
+    GroupCommitQueue(Database &db, std::chrono::steady_clock::duration window = DefaultWindow, size_t batch_size = DefaultBatchSize):
+        m_Database(db),
+        m_Window(window),
+        m_BatchSize(batch_size)
+    {}
+
+    GroupCommitQueue(const GroupCommitQueue &) = delete;
+
+    GroupCommitQueue &operator=(const GroupCommitQueue &) = delete;
+
+    ~GroupCommitQueue(){
+        Flush();
+    }
+
+    void Submit(WriteType write, CommittedType on_committed = nullptr){
+        std::lock_guard<std::mutex> lock(m_Lock);
+        if(m_Pending.empty())
+            m_FirstPendingTime = std::chrono::steady_clock::now();
+        m_Pending.push_back({Move(write), Move(on_committed)});
+    }
+
+    // Commits once the oldest pending write has waited for the window or the batch is full
+    size_t Pump(){
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            if(m_Pending.empty())
+                return 0;
+            if(m_Pending.size() < m_BatchSize && std::chrono::steady_clock::now() - m_FirstPendingTime < m_Window)
+                return 0;
+        }
+        return Flush();
+    }
+
+    // Commits everything submitted so far, returns the number of writes that made it
+    size_t Flush(){
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            std::swap(m_Batch, m_Pending);
+        }
+        if(m_Batch.empty())
+            return 0;
+
+        size_t committed = 0;
+        size_t ran = 0;
+        {
+            Transaction batch(m_Database);
+
+            // Without the batch every write would wait out the busy timeout on its own
+            for(; ran < m_Batch.size() && batch.IsActive(); ran++){
+                PendingWrite &pending = m_Batch[ran];
+                Transaction single(m_Database);
+                if(pending.Write(m_Database) && single.Commit()){
+                    committed++;
+                    if(pending.OnCommitted)
+                        m_Committed.push_back(Move(pending.OnCommitted));
+                }else{
+                    m_Stats.FailedWrites++;
+                }
+            }
+
+            if(batch.Commit()){
+                m_Stats.Commits++;
+                m_Stats.Writes += committed;
+            }else{
+                m_Stats.FailedWrites += committed + m_Batch.size() - ran;
+                committed = 0;
+                m_Committed.clear();
+            }
+        }
+        m_Batch.clear();
+
+        for(CommittedType &on_committed: m_Committed)
+            on_committed();
+        m_Committed.clear();
+
+        return committed;
+    }
+
+    const Stats &GetStats()const{
+        return m_Stats;
+    }
+};
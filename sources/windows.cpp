@@ -6,8 +6,16 @@
 #include <unordered_map>
 #include <functional>
 #include <map>
+#include <optional>
 #include "helpers.cpp"
 #include "mediators.cpp"
+#include "schema.cpp"
+#include "executor.cpp"
+#include "transaction.cpp"
+#include "importer.cpp"
+#include "backup.cpp"
+#include "snapshot.cpp"
+#include "session.cpp"
 #include "imgui_internal.h"
 
 static std::map<std::string, float> s_Available;
@@ -107,6 +115,22 @@ namespace ImGui
     void InputDate(const char* label, Date& date) {
         return InputDate(label, date.Day, date.Month, date.Year);
     }
+
+    // Keeps the one line height list clippers rely on, the whole text is shown while hovered
+    void TextFirstLine(const char *text) {
+        const char *end = strchr(text, '\n');
+        if (!end)
+            return ImGui::TextUnformatted(text);
+
+        ImGui::TextUnformatted(text, end);
+        bool is_hovered = ImGui::IsItemHovered();
+        ImGui::SameLine(0, 0);
+        ImGui::TextDisabled(" ...");
+        is_hovered |= ImGui::IsItemHovered();
+
+        if (is_hovered)
+            ImGui::SetTooltip("%s", text);
+    }
 }
 
 class NewIngredientPopup{
@@ -139,14 +163,13 @@ public:
             auto current_source = m_SourcesTable.Query(m_SourceID);
 
             if (ImGui::BeginCombo("##IngredientsCombo",
-                                  current_source ? current_source.GetColumnString(1) : "None")) {
+                                  current_source ? current_source.Current().Name : "None")) {
                 auto sources_query = m_SourcesTable.Query();
                 for (; sources_query; sources_query.Next()) {
-                    int id = sources_query.GetColumnInt(0);
-                    const char *name = sources_query.GetColumnString(1);
+                    SourceRow source = sources_query.Current();
 
-                    if (ImGui::Selectable(name))
-                        m_SourceID = id;
+                    if (ImGui::Selectable(source.Name))
+                        m_SourceID = source.ID;
                 }
                 ImGui::EndCombo();
             }
@@ -184,11 +207,13 @@ private:
     IngredientsTableMediator m_IngredientsTable;
     SourcesTableMediator m_SourcesTable;
     NewIngredientPopup m_NewIngredientPopup;
+    KeysetPager<IngredientRow> m_Ingredients;
 public:
     IngredientsListPanel(Database &db):
             m_NewIngredientPopup(db),
             m_IngredientsTable(db),
-            m_SourcesTable(db)
+            m_SourcesTable(db),
+            m_Ingredients(db)
     {}
 
     void Draw(){
@@ -208,24 +233,33 @@ public:
 
         ImGui::BeginChild("##List");
 
-        QueryResult query = m_IngredientsTable.Query();
+        m_Ingredients.Update();
 
         if(ImGui::BeginTable("Ingredients", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)){
             ImGui::TableSetupColumn("Name");
             ImGui::TableSetupColumn("Units");
             ImGui::TableSetupColumn("Source");
             ImGui::TableHeadersRow();
-            for( ;query; query.Next()){
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
-                ImGui::Text("%s", query.GetColumnString(1));
-                ImGui::TableNextColumn();
-                ImGui::Text("%s", query.GetColumnString(2));
-                ImGui::TableNextColumn();
-                auto source = m_SourcesTable.Query(query.GetColumnInt(3));
-                ImGui::Text("%s", source.GetColumnString(1));
 
+            ImGuiListClipper clipper;
+            clipper.Begin((int)m_Ingredients.Size());
+            while(clipper.Step()){
+                m_Ingredients.Fetch(clipper.DisplayStart, clipper.DisplayEnd);
+                for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++){
+                    IngredientRow ingredient;
+                    ImGui::TableNextRow();
+                    if(!m_Ingredients.Get(i, ingredient))
+                        continue;
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", ingredient.Name);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", ingredient.Units);
+                    ImGui::TableNextColumn();
+                    auto source = m_SourcesTable.Query(ingredient.SourceID);
+                    ImGui::Text("%s", source.Current().Name);
+                }
             }
+            clipper.End();
             ImGui::EndTable();
         }
         ImGui::EndChild();
@@ -287,10 +321,12 @@ class WaitersListPanel{
 private:
     WaitersTableMediator m_WaitersTable;
     NewWaiterPopup m_NewWaiterPopup;
+    KeysetPager<WaiterRow> m_Waiters;
 public:
     WaitersListPanel(Database &db):
             m_WaitersTable(db),
-            m_NewWaiterPopup(db)
+            m_NewWaiterPopup(db),
+            m_Waiters(db)
     {}
 
     void Draw(){
@@ -310,7 +346,7 @@ public:
 
         ImGui::BeginChild("##List");
 
-        QueryResult query = m_WaitersTable.Query();
+        m_Waiters.Update();
 
         if(ImGui::BeginTable("Waiters", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)){
             ImGui::TableSetupColumn("Name");
@@ -318,15 +354,24 @@ public:
             ImGui::TableSetupColumn("Age");
             ImGui::TableHeadersRow();
 
-            for( ;query; query.Next()){
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
-                ImGui::Text("%s", query.GetColumnString(1));
-                ImGui::TableNextColumn();
-                ImGui::Text("%f", query.GetColumnFloat(2));
-                ImGui::TableNextColumn();
-                ImGui::Text("%d", query.GetColumnInt(3));
+            ImGuiListClipper clipper;
+            clipper.Begin((int)m_Waiters.Size());
+            while(clipper.Step()){
+                m_Waiters.Fetch(clipper.DisplayStart, clipper.DisplayEnd);
+                for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++){
+                    WaiterRow waiter;
+                    ImGui::TableNextRow();
+                    if(!m_Waiters.Get(i, waiter))
+                        continue;
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", waiter.ShortName);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%f", waiter.Salary);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%d", waiter.FullAge);
+                }
             }
+            clipper.End();
             ImGui::EndTable();
         }
         ImGui::EndChild();
@@ -386,10 +431,12 @@ class GobletsListPanel{
 private:
     GobletsTableMediator m_GobletsTable;
     NewGobletPopup m_NewGobletPopup;
+    KeysetPager<GobletRow> m_Goblets;
 public:
     GobletsListPanel(Database &db):
             m_GobletsTable(db),
-            m_NewGobletPopup(db)
+            m_NewGobletPopup(db),
+            m_Goblets(db)
     {}
 
     void Draw(){
@@ -409,20 +456,29 @@ public:
 
         ImGui::BeginChild("##List");
 
-        QueryResult query = m_GobletsTable.Query();
+        m_Goblets.Update();
 
         if(ImGui::BeginTable("Goblets", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)){
             ImGui::TableSetupColumn("Name");
             ImGui::TableSetupColumn("Capacity");
             ImGui::TableHeadersRow();
 
-            for( ;query; query.Next()){
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
-                ImGui::Text("%s", query.GetColumnString(1));
-                ImGui::TableNextColumn();
-                ImGui::Text("%.1f", query.GetColumnFloat(2));
+            ImGuiListClipper clipper;
+            clipper.Begin((int)m_Goblets.Size());
+            while(clipper.Step()){
+                m_Goblets.Fetch(clipper.DisplayStart, clipper.DisplayEnd);
+                for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++){
+                    GobletRow goblet;
+                    ImGui::TableNextRow();
+                    if(!m_Goblets.Get(i, goblet))
+                        continue;
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", goblet.Name);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f", goblet.Capacity);
+                }
             }
+            clipper.End();
             ImGui::EndTable();
         }
         ImGui::EndChild();
@@ -469,7 +525,7 @@ public:
 
                 auto address = m_AddressesTable.Query(m_City.Data(), m_House.Data(), m_PostalCode);
 
-                m_SourcesTable.Add(m_SourceName.Data(), address.GetColumnInt(0));
+                m_SourcesTable.Add(m_SourceName.Data(), address.Current().ID);
 
                 ImGui::CloseCurrentPopup();
             }
@@ -628,10 +684,11 @@ public:
             ImGui::Text("Order from: %s", m_Source.c_str());
 
             for (auto query = m_DrinksTable.Query(); query; query.Next()) {
-                auto name = query.GetColumnString(1);
+                DrinkRow drink = query.Current();
+                auto name = drink.Name;
                 int &count = m_OrderCounts[name];
 
-                ImGui::PushID(query.GetColumnInt(0));
+                ImGui::PushID(drink.ID);
                 ImGui::Text("%s", name);
                 ImGui::SameLine();
                 ImGui::Text("Available: %.2f, ", GetAvailableDrinks(name));
@@ -681,12 +738,14 @@ private:
     NewSourcePopup m_NewSourcePopup;
 
     NewDrinkOrderPopup m_DrinkOrderPopup;
+    KeysetPager<SourceRow> m_Sources;
 public:
     SourcesListPanel(Database &db, DrinksTransferProgressWindow &transfer):
             m_SourcesTable(db),
             m_AddressesTable(db),
             m_NewSourcePopup(db),
-            m_DrinkOrderPopup(db, transfer)
+            m_DrinkOrderPopup(db, transfer),
+            m_Sources(db)
     {}
 
     void Draw(){
@@ -705,6 +764,7 @@ public:
 
         ImGui::BeginChild("##List");
 
+        m_Sources.Update();
 
         if(ImGui::BeginTable("Sources", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)){
             ImGui::TableSetupColumn("Name");
@@ -712,27 +772,36 @@ public:
             ImGui::TableSetupColumn("PostalCode");
             ImGui::TableHeadersRow();
 
-            QueryResult query = m_SourcesTable.Query();
-            for( ;query; query.Next()){
-                ImGui::PushID(query.GetColumnInt(0));
+            ImGuiListClipper clipper;
+            clipper.Begin((int)m_Sources.Size());
+            while(clipper.Step()){
+                m_Sources.Fetch(clipper.DisplayStart, clipper.DisplayEnd);
+                for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++){
+                    SourceRow source;
+                    ImGui::TableNextRow();
+                    if(!m_Sources.Get(i, source))
+                        continue;
+                    ImGui::PushID(source.ID);
 
-                auto address = m_AddressesTable.Query(query.GetColumnInt(2));
+                    auto address_query = m_AddressesTable.Query(source.AddressID);
+                    AddressRow address = address_query.Current();
 
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
-                ImGui::Text("%s", query.GetColumnString(1));
-                ImGui::TableNextColumn();
-                ImGui::Text("%s", address.GetColumnString(1));
-                ImGui::TableNextColumn();
-                ImGui::Text("%d", query.GetColumnInt(3));
-                ImGui::TableNextColumn();
-                if (ImGui::Button("Order")) {
-                    m_DrinkOrderPopup.Open(query.GetColumnString(1));
-                }
-                m_DrinkOrderPopup.Draw();
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", source.Name);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", address.City);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%d", address.PostalCode);
+                    ImGui::TableNextColumn();
+                    if (ImGui::Button("Order")) {
+                        m_DrinkOrderPopup.Open(source.Name);
+                    }
+                    m_DrinkOrderPopup.Draw();
 
-                ImGui::PopID();
+                    ImGui::PopID();
+                }
             }
+            clipper.End();
             ImGui::EndTable();
         }
         ImGui::EndChild();
@@ -756,8 +825,6 @@ private:
     float m_PricePerLiter = 0.f;
     int m_AgeRestriction = 0;
 
-    int m_LastID{(int)m_DrinksTable.Size()};
-
     IngredientAddInfo m_CurrentIngredient;
 
     List<IngredientAddInfo> m_Ingredients;
@@ -784,14 +851,13 @@ public:
             auto current_ingredient = m_IngredientsTable.Query(m_CurrentIngredient.ID);
 
             if (ImGui::BeginCombo("##IngredientsCombo",
-                                  current_ingredient ? current_ingredient.GetColumnString(1) : "None")) {
+                                  current_ingredient ? current_ingredient.Current().Name : "None")) {
                 auto ingredients_query = m_IngredientsTable.Query();
                 for (; ingredients_query; ingredients_query.Next()) {
-                    int id = ingredients_query.GetColumnInt(0);
-                    const char *name = ingredients_query.GetColumnString(1);
+                    IngredientRow ingredient = ingredients_query.Current();
 
-                    if (ImGui::Selectable(name))
-                        m_CurrentIngredient.ID = id;
+                    if (ImGui::Selectable(ingredient.Name))
+                        m_CurrentIngredient.ID = ingredient.ID;
                 }
                 ImGui::EndCombo();
             }
@@ -812,7 +878,7 @@ public:
                     auto ingredient = m_IngredientsTable.Query(info.ID);
                     ImGui::TableNextRow();
                     ImGui::TableNextColumn();
-                    ImGui::Text("%s", ingredient.GetColumnString(1));
+                    ImGui::Text("%s", ingredient.Current().Name);
                     ImGui::TableNextColumn();
                     ImGui::Text("%.2f", info.Amount);
                 }
@@ -822,14 +888,17 @@ public:
 
             if (ImGui::Button("Add")
             && m_Ingredients.Size()) {
-                m_DrinksTable.Add(
-                        ++m_LastID,
+                Transaction transaction(m_DrinksTable.GetDatabase());
+                const int drink_id = m_DrinksTable.Add(
                         m_DrinkName.Data(),
                         m_PricePerLiter,
                         m_AgeRestriction
                 );
-                for(auto info: m_Ingredients)
-                    m_IngredientsDrinksTable.Add(info.ID, info.Amount, m_LastID);
+                if(drink_id != -1){
+                    for(auto info: m_Ingredients)
+                        m_IngredientsDrinksTable.Add(info.ID, info.Amount, drink_id);
+                    transaction.Commit();
+                }
                 ImGui::CloseCurrentPopup();
             }
             
@@ -855,12 +924,14 @@ private:
     IngredientsTableMediator m_IngredientsTable;
     IngredientsDrinksTableMediator m_IngredientsDrinksTable;
     NewDrinkPopup m_NewDrinkPopup;
+    KeysetPager<DrinkRow> m_Drinks;
 public:
     DrinksListPanel(Database &db):
         m_DrinksTable(db),
         m_NewDrinkPopup(db),
         m_IngredientsTable(db),
-        m_IngredientsDrinksTable(db)
+        m_IngredientsDrinksTable(db),
+        m_Drinks(db)
     {}
 
     void Draw(){
@@ -880,8 +951,7 @@ public:
 
         ImGui::BeginChild("##List");
 
-        QueryResult query = m_DrinksTable.Query();
-
+        m_Drinks.Update();
 
         if(ImGui::BeginTable("Drinks", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)){
             ImGui::TableSetupColumn("Name");
@@ -890,40 +960,47 @@ public:
             ImGui::TableSetupColumn("Available");
 
             ImGui::TableHeadersRow();
-            for( ;query; query.Next()){
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
-                ImGui::Text("%s", query.GetColumnString(1));
 
-                if(ImGui::IsItemHovered()) {
-                    int drink_id = query.GetColumnInt(0);
+            ImGuiListClipper clipper;
+            clipper.Begin((int)m_Drinks.Size());
+            while(clipper.Step()){
+                m_Drinks.Fetch(clipper.DisplayStart, clipper.DisplayEnd);
+                for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++){
+                    DrinkRow drink;
+                    ImGui::TableNextRow();
+                    if(!m_Drinks.Get(i, drink))
+                        continue;
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", drink.Name);
+
+                    if(ImGui::IsItemHovered()) {
+                        //Yes, it is fucking horrible, i know
+                        std::stringstream tooltip;
 
-                    //Yes, it is fucking horrible, i know
-                    std::stringstream tooltip;
+                        auto ingredients_of_drink = m_IngredientsDrinksTable.Query(drink.ID);
 
-                    QueryResult ingredients_of_drink = m_IngredientsDrinksTable.Query(drink_id);
 
+                        for(; ingredients_of_drink; ingredients_of_drink.Next()){
+                            IngredientDrinkRow usage = ingredients_of_drink.Current();
 
-                    for(; ingredients_of_drink; ingredients_of_drink.Next()){
-                        int ingredient_id = ingredients_of_drink.GetColumnInt(0);
-                        float units = ingredients_of_drink.GetColumnFloat(1);
+                            auto ingredient_query = m_IngredientsTable.Query(usage.IngredientID);
+                            IngredientRow ingredient = ingredient_query.Current();
 
-                        QueryResult ingredient = m_IngredientsTable.Query(ingredient_id);
+                            tooltip << ingredient.Name << ' ' << usage.UnitsCount << ' ' << ingredient.Units << '\n';
+                        }
 
-                        tooltip << ingredient.GetColumnString(1) << ' ' << units << ' ' << ingredient.GetColumnString(2) << '\n';
+                        ImGui::SetTooltip(tooltip.str().c_str());
                     }
 
-                    ImGui::SetTooltip(tooltip.str().c_str());
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%f", drink.PricePerLiter);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%d", drink.AgeRestriction);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f Liters", GetAvailableDrinks(drink.Name));
                 }
-
-                ImGui::TableNextColumn();
-                ImGui::Text("%f", query.GetColumnFloat(2));
-                ImGui::TableNextColumn();
-                ImGui::Text("%d", query.GetColumnInt(3));
-                ImGui::TableNextColumn();
-                ImGui::Text("%.1f Liters", GetAvailableDrinks(query.GetColumnString(1)));
-
             }
+            clipper.End();
             ImGui::EndTable();
         }
         ImGui::EndChild();
@@ -937,10 +1014,11 @@ struct DrinkOrder{
     int GobletID;
 };
 
-std::string GetGobletName(const QueryResult &query){
+std::string GetGobletName(const TypedQueryResult<GobletRow> &query){
     if(!query)return "None";
 
-    return query.GetColumnString(1) + std::string(" ") + std::to_string(query.GetColumnFloat(2)) + "l";
+    GobletRow goblet = query.Current();
+    return goblet.Name + std::string(" ") + std::to_string(goblet.Capacity) + "l";
 }
 
 class NewOrderPopup{
@@ -951,6 +1029,7 @@ private:
     DrinkOrdersTableMediator m_DrinksOrdersTable;
     OrdersLogTableMediator m_OrdersLogTable;
     WaitersTableMediator m_WaitersTable;
+    GroupCommitQueue &m_Writes;
 
     InputBuffer<BufferSize> m_CustomerName;
     float m_Tips = 0.f;
@@ -967,12 +1046,13 @@ private:
 
     const char *const m_Name = "New Order";
 public:
-    NewOrderPopup(Database &db):
+    NewOrderPopup(Database &db, GroupCommitQueue &writes):
             m_DrinksTable(db),
             m_GobletsTable(db),
             m_DrinksOrdersTable(db),
             m_OrdersLogTable(db),
-            m_WaitersTable(db)
+            m_WaitersTable(db),
+            m_Writes(writes)
     {}
 
     void Open(){
@@ -988,7 +1068,7 @@ public:
 
             if (!drink_query || !goblet_query)continue;
             
-            usage[drink_query.GetColumnString(1)] += goblet_query.GetColumnFloat(2);
+            usage[drink_query.Current().Name] += goblet_query.Current().Capacity;
         }
 
         return usage;
@@ -1019,14 +1099,13 @@ public:
         if(ImGui::BeginPopup(m_Name)) {
             ImGui::InputText("Customer Codename", m_CustomerName.Data(), m_CustomerName.Size());
             if (ImGui::BeginCombo("##WaitersCombo",
-                                  m_CurrentWaiterID != -1 ? m_WaitersTable.Query(m_CurrentWaiterID).GetColumnString(1) : "None")) {
+                                  m_CurrentWaiterID != -1 ? m_WaitersTable.Query(m_CurrentWaiterID).Current().ShortName : "None")) {
                 auto waiters_query= m_WaitersTable.Query();
                 for (; waiters_query; waiters_query.Next()) {
-                    int id = waiters_query.GetColumnInt(0);
-                    const char *name = waiters_query.GetColumnString(1);
+                    WaiterRow waiter = waiters_query.Current();
 
-                    if (ImGui::Selectable(name))
-                        m_CurrentWaiterID = id;
+                    if (ImGui::Selectable(waiter.ShortName))
+                        m_CurrentWaiterID = waiter.ID;
                 }
                 ImGui::EndCombo();
             }
@@ -1040,7 +1119,7 @@ public:
 
             ImGui::PushItemWidth(ImGui::GetWindowSize().x / 3);
 
-            auto current_name = selected_drink_query.GetColumnString(1);
+            auto current_name = selected_drink_query.Current().Name;
 
             if(!IsAvailable(current_name))
                 m_CurrentDrinkID = -1;
@@ -1049,8 +1128,9 @@ public:
                                   IsAvailable(current_name) ? current_name : "None")) {
                 auto drink_query = m_DrinksTable.Query();
                 for (; drink_query; drink_query.Next()) {
-                    int id = drink_query.GetColumnInt(0);
-                    const char *name = drink_query.GetColumnString(1);
+                    DrinkRow drink = drink_query.Current();
+                    int id = drink.ID;
+                    const char *name = drink.Name;
 
                     bool is_available = IsAvailable(name);
 
@@ -1069,7 +1149,7 @@ public:
           if(m_CurrentDrinkID != -1){
             ImGui::SameLine();
              
-            float current_capacity = m_GobletsTable.Query(m_CurrentGobletID).GetColumnFloat(2);
+            float current_capacity = m_GobletsTable.Query(m_CurrentGobletID).Current().Capacity;
 
             if(!IsAvailableForGoblet(current_name, current_capacity))
                 m_CurrentGobletID = -1;
@@ -1077,15 +1157,14 @@ public:
             if (ImGui::BeginCombo("##GobletsCombo", GetGobletName(m_GobletsTable.Query(m_CurrentGobletID)).c_str())) {
                 auto goblet_query = m_GobletsTable.Query();
                 for (; goblet_query; goblet_query.Next()) {
-                    int id = goblet_query.GetColumnInt(0);
-                    float capacity = goblet_query.GetColumnFloat(2);
+                    GobletRow goblet = goblet_query.Current();
                     std::string name = GetGobletName(goblet_query);
 
-                    bool is_available = IsAvailableForGoblet(current_name, capacity);
+                    bool is_available = IsAvailableForGoblet(current_name, goblet.Capacity);
 
                     if(!is_available)ImGui::PushDisabled();
                     if (ImGui::Selectable(name.c_str()))
-                        m_CurrentGobletID = id;
+                        m_CurrentGobletID = goblet.ID;
                     if(!is_available)ImGui::PopDisabled();
                 }
                 ImGui::EndCombo();
@@ -1108,13 +1187,15 @@ public:
 
                     if (!drink_query || !goblet_query)continue;
 
+                    GobletRow goblet = goblet_query.Current();
+
                     ImGui::TableNextRow();
                     ImGui::TableNextColumn();
-                    ImGui::Text("%s", drink_query.GetColumnString(1));
+                    ImGui::Text("%s", drink_query.Current().Name);
                     ImGui::TableNextColumn();
-                    ImGui::Text("%s", goblet_query.GetColumnString(1));
+                    ImGui::Text("%s", goblet.Name);
                     ImGui::TableNextColumn();
-                    ImGui::Text("%.1f", goblet_query.GetColumnFloat(2));
+                    ImGui::Text("%.1f", goblet.Capacity);
                 }
                 ImGui::EndTable();
             }
@@ -1122,10 +1203,8 @@ public:
             float checkout = 0;
 
             for (DrinkOrder drink_order : m_Drinks) {
-                QueryResult drink = m_DrinksTable.Query(drink_order.DrinkID);
-                QueryResult goblet = m_GobletsTable.Query(drink_order.GobletID);
-                float price_per_liter = drink.GetColumnFloat(2);
-                float capacity = goblet.GetColumnFloat(2);
+                float price_per_liter = m_DrinksTable.Query(drink_order.DrinkID).Current().PricePerLiter;
+                float capacity = m_GobletsTable.Query(drink_order.GobletID).Current().Capacity;
                 checkout += price_per_liter * capacity;
             }
 
@@ -1139,15 +1218,27 @@ public:
                     m_CurrentMonth,
                     m_CurrentYear
                 };
-                int id = m_OrdersLogTable.Add(m_CustomerName.Data(), m_Tips, m_CurrentWaiterID, checkout, date);
-
-                for (auto drink: m_Drinks) {
-                    m_DrinksOrdersTable.Add(id, drink.DrinkID, drink.GobletID);
-                }
-
-                for (auto usage : Usage()) {
-                    GetAvailableDrinks(usage.first.c_str()) -= usage.second;
-                }
+                std::string customer_name = m_CustomerName.Data();
+                std::vector<DrinkOrder> drinks;
+                for (auto drink: m_Drinks)
+                    drinks.push_back(drink);
+                float tips = m_Tips;
+                int waiter_id = m_CurrentWaiterID;
+
+                m_Writes.Submit([this, customer_name, drinks, tips, waiter_id, checkout, date](Database &){
+                    int id = m_OrdersLogTable.Add(customer_name.c_str(), tips, waiter_id, checkout, date);
+                    if(id == -1)
+                        return false;
+
+                    for (auto drink: drinks) {
+                        if(!m_DrinksOrdersTable.Add(id, drink.DrinkID, drink.GobletID))
+                            return false;
+                    }
+                    return true;
+                }, [usage = Usage()](){
+                    for (auto &drink_usage : usage)
+                        GetAvailableDrinks(drink_usage.first.c_str()) -= drink_usage.second;
+                });
 
                 ImGui::CloseCurrentPopup();
             }
@@ -1179,14 +1270,16 @@ private:
     GobletsTableMediator m_GobletsTable;
     WaitersTableMediator m_WaitersTable;
     NewOrderPopup m_NewOrderPopup;
+    KeysetPager<OrderRow> m_Orders;
 public:
-    OrdersLogPanel(Database &db):
+    OrdersLogPanel(Database &db, GroupCommitQueue &writes):
             m_DrinkOrders(db),
             m_OrdersLog(db),
             m_DrinksTable(db),
             m_GobletsTable(db),
-            m_NewOrderPopup(db),
-            m_WaitersTable(db)
+            m_NewOrderPopup(db, writes),
+            m_WaitersTable(db),
+            m_Orders(db)
     {}
 
     void Draw(){
@@ -1208,40 +1301,44 @@ public:
 
         ImGui::BeginChild("##List");
 
-        QueryResult orders = m_OrdersLog.Query();
-
-        for( ;orders; orders.Next()){
-            int order_id = orders.GetColumnInt(0);
-            const char *customer_name = orders.GetColumnString(1);
-            float tips = orders.GetColumnFloat(2);
-            int waiter_id = orders.GetColumnInt(3);
-            ImGui::Text("CustomerName: %s", customer_name);
-            ImGui::Text("Waiter: %s", m_WaitersTable.Query(waiter_id).GetColumnString(1));
-            ImGui::Text("Tips: %f", tips);
-
-            if(ImGui::BeginTable("##Drinks_", 3, ImGuiTableFlags_RowBg)){
-
-                QueryResult order_drinks = m_DrinkOrders.Query(order_id);
-
-                for(; order_drinks; order_drinks.Next()){
-                    QueryResult drink = m_DrinksTable.Query(order_drinks.GetColumnInt(1));
-                    QueryResult goblet = m_GobletsTable.Query(order_drinks.GetColumnInt(2));
+        m_Orders.Update();
+
+        // An order is a row of its own so every row has the same height,
+        // its drinks show up in a tooltip
+        if(ImGui::BeginTable("Orders", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)){
+            ImGui::TableSetupColumn("Customer");
+            ImGui::TableSetupColumn("Waiter");
+            ImGui::TableSetupColumn("Drinks");
+            ImGui::TableSetupColumn("Tips");
+            ImGui::TableSetupColumn("Checkout");
+            ImGui::TableSetupColumn("Date");
+            ImGui::TableHeadersRow();
 
+            ImGuiListClipper clipper;
+            clipper.Begin((int)m_Orders.Size());
+            while(clipper.Step()){
+                m_Orders.Fetch(clipper.DisplayStart, clipper.DisplayEnd);
+                for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++){
+                    OrderRow order;
                     ImGui::TableNextRow();
+                    if(!m_Orders.Get(i, order))
+                        continue;
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", order.CustomerShortName);
                     ImGui::TableNextColumn();
-                    ImGui::Text("%s", drink.GetColumnString(1));
+                    ImGui::Text("%s", m_WaitersTable.Query(order.WaiterID).Current().ShortName);
                     ImGui::TableNextColumn();
-                    ImGui::Text("%s", goblet.GetColumnString(1));
+                    DrawDrinks(order.ID);
                     ImGui::TableNextColumn();
-                    ImGui::Text("%.1f", goblet.GetColumnFloat(2));
+                    ImGui::Text("%f", order.Tips);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", order.Checkout);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", order.OrderDate);
                 }
-
-                ImGui::EndTable();
             }
-            ImGui::Text("Checkout: %.2f", orders.GetColumnFloat(4));
-            ImGui::Text("Date: %s", orders.GetColumnString(5));
-
-            ImGui::Separator();
+            clipper.End();
+            ImGui::EndTable();
         }
 
         ImGui::EndChild();
@@ -1249,16 +1346,56 @@ public:
         ImGui::End();
 
 
+    }
+private:
+    // The count, the drinks themselves are only looked up while hovered
+    void DrawDrinks(int order_id){
+        auto order_drinks = m_DrinkOrders.Query(order_id);
+        int count = 0;
+        for(; order_drinks; order_drinks.Next())
+            count++;
+        ImGui::Text("%d", count);
+
+        if(!ImGui::IsItemHovered())
+            return;
+
+        ImGui::BeginTooltip();
+        if(ImGui::BeginTable("##Drinks_", 3, ImGuiTableFlags_RowBg)){
+            for(order_drinks.Reset(); order_drinks; order_drinks.Next()){
+                DrinkOrderRow drink_order = order_drinks.Current();
+                auto drink = m_DrinksTable.Query(drink_order.DrinkID);
+                auto goblet_query = m_GobletsTable.Query(drink_order.GobletID);
+                GobletRow goblet = goblet_query.Current();
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", drink.Current().Name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", goblet.Name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", goblet.Capacity);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::EndTooltip();
     }
 };
 
 class AnalyticsWindow{
 private:
-    Database &m_DB;
-    DrinksTableMediator m_DrinksTable{m_DB};
-    WaitersTableMediator m_WaitersTable{m_DB};
-    OrdersLogTableMediator m_OrdersLogTable{m_DB};
-    DrinkOrdersTableMediator m_DrinkOrdersTable{m_DB};
+    struct ShareChart{
+        List<const char *> Names;
+        List<float> Values;
+    };
+
+    struct Totals{
+        int Orders = 0;
+        float Checkout = 0;
+        float Tips = 0;
+    };
+
+    BrewerySnapshot &m_Snapshot;
+    uint64_t m_SnapshotVersion = 0;
 
     Date m_WaitersBegin{1, 1, 2020};
     Date m_WaitersEnd{1, 1, 2024};
@@ -1266,6 +1403,13 @@ private:
     Date m_DrinkMarketBegin{1, 1, 2020};
     Date m_DrinkMarketEnd{1, 1, 2024};
 
+    ShareChart m_WaitersStats;
+    ShareChart m_DrinkMarketStats;
+    Totals m_WaitersTotals;
+
+    bool m_IsWaitersStatsStale = true;
+    bool m_IsDrinkMarketStatsStale = true;
+
 private:
     static double DateToDouble(std::string date) {
         int day;
@@ -1282,111 +1426,165 @@ private:
         int year = (int)date / 10000;
         return StringPrint("%-%-%", year, month, day);
     }
-   
-public:
-    AnalyticsWindow(Database &db): 
-        m_DB(db) 
-    {}
 
-    void Draw() {
-        ImGui::Begin("Stats");
-        
-        
-        std::unordered_map<std::string, float> checkouts;
+    static bool IsSameDate(const Date &left, const Date &right){
+        return left.Day == right.Day && left.Month == right.Month && left.Year == right.Year;
+    }
 
-        for (auto query = m_OrdersLogTable.Query(); query; query.Next()) {
-            float checkout = query.GetColumnFloat(4);
-            std::string date = query.GetColumnString(5) ? query.GetColumnString(5) : "Null";
-            
-            checkouts[date] += checkout;
-        }
+    static bool InputDateRange(const char *begin_label, Date &begin, const char *end_label, Date &end){
+        const Date old_begin = begin;
+        const Date old_end = end;
 
-        const auto win_size = ImGui::GetContentRegionAvail();
-        const int plot_count = 3;
-        const auto plot_size = ImVec2{win_size.x * 0.6f, win_size.y * 0.6f};
+        ImGui::InputDate(begin_label, begin);
+        ImGui::InputDate(end_label, end);
 
-        ImGui::InputDate("Waiters Start", m_WaitersBegin);
+        return !IsSameDate(old_begin, begin) || !IsSameDate(old_end, end);
+    }
 
-        ImGui::InputDate("Waiters End", m_WaitersEnd);
-        
-        if (ImPlot::BeginPlot("Waiters stats", plot_size)) {
-            List<String> names;
-            List<float> values;
-            List<const char *> names_ptr;
+    // Dates are stored as text built the same way, and compared as text like BETWEEN does
+    std::vector<bool> DatesBetween(const Date &begin, const Date &end)const{
+        const String begin_text = StringPrint("%-%-%", begin.Year, begin.Month, begin.Day);
+        const String end_text = StringPrint("%-%-%", end.Year, end.Month, end.Day);
+        const StringDictionary &dates = m_Snapshot.Dates();
 
-            std::map<int, int> orders_by_waiter;
+        std::vector<bool> is_between(dates.Size() + 1);
+        dates.ForEachBetween(begin_text.Data(), end_text.Data(), [&](uint32_t code){
+            is_between[code] = true;
+        });
+        return is_between;
+    }
 
-            for (auto query = m_OrdersLogTable.Query(m_WaitersBegin, m_WaitersEnd); query; query.Next()) {
-                int waiter_id = query.GetColumnInt(3);
+    // Counts are turned into shares of the total
+    static void AddShares(ShareChart &chart, const char *name, float count){
+        chart.Names.Add(name ? name : "None");
+        chart.Values.Add(count);
+    }
 
-                orders_by_waiter[waiter_id] += 1;
-            }
+    static void NormalizeShares(ShareChart &chart){
+        float sum = 0;
 
-            for (auto [waiter_id, orders] : orders_by_waiter) {
-                auto query = m_WaitersTable.Query(waiter_id);
-                auto waiter_name = query.GetColumnString(1);
-                names.Add(waiter_name);
-                names_ptr.Add(names.Last().Data());
-                values.Add(orders);
-            }
+        for (auto value : chart.Values) 
+            sum += value; 
 
-            float sum = 0;
-            
-            for (auto value : values) 
-                sum += value; 
+        for (float &value : chart.Values) value = (value / sum) * 100;
+    }
 
-            for (float &value : values) value = (value / sum) * 100;
+    void ComputeWaitersStats(){
+        const auto &orders = m_Snapshot.Orders();
+        const auto &dates = orders.Column<&OrderRow::OrderDate>();
+        const auto &waiter_ids = orders.Column<&OrderRow::WaiterID>();
+        const auto &checkouts = orders.Column<&OrderRow::Checkout>();
+        const auto &tips = orders.Column<&OrderRow::Tips>();
+        const std::vector<bool> is_between = DatesBetween(m_WaitersBegin, m_WaitersEnd);
+
+        std::unordered_map<int, int> orders_by_waiter;
+        m_WaitersTotals = {};
+
+        for (size_t i = 0; i < orders.Size(); i++) {
+            if (!is_between[dates[i]])
+                continue;
+
+            orders_by_waiter[waiter_ids[i]] += 1;
+            m_WaitersTotals.Orders++;
+            m_WaitersTotals.Checkout += checkouts[i];
+            m_WaitersTotals.Tips += tips[i];
+        }
 
+        const auto &waiters = m_Snapshot.Waiters();
+        const auto &ids = waiters.Column<&WaiterRow::ID>();
+        const auto &names = waiters.Column<&WaiterRow::ShortName>();
 
-            ImPlot::PlotPieChart(names_ptr.Data(), values.Data(), values.Size(),
-                                 0, 0, 1, "%.1f%%");
+        m_WaitersStats = {};
+        for (size_t i = 0; i < waiters.Size(); i++) {
+            auto it = orders_by_waiter.find(ids[i]);
+            if (it != orders_by_waiter.end())
+                AddShares(m_WaitersStats, m_Snapshot.Strings().Decode(names[i]), it->second);
+        }
+        NormalizeShares(m_WaitersStats);
+    }
 
-            ImPlot::EndPlot();
+    void ComputeDrinkMarketStats(){
+        const auto &orders = m_Snapshot.Orders();
+        const auto &dates = orders.Column<&OrderRow::OrderDate>();
+        const auto &order_ids = orders.Column<&OrderRow::ID>();
+        const std::vector<bool> is_between = DatesBetween(m_DrinkMarketBegin, m_DrinkMarketEnd);
+
+        std::unordered_map<int, int> orders_in_range;
+        for (size_t i = 0; i < orders.Size(); i++) {
+            if (is_between[dates[i]])
+                orders_in_range[order_ids[i]] += 1;
         }
 
-        ImGui::InputDate("Market Share Start", m_DrinkMarketBegin);
+        const auto &drink_orders = m_Snapshot.DrinkOrders();
+        const auto &ordered_in = drink_orders.Column<&DrinkOrderRow::OrderID>();
+        const auto &ordered_drinks = drink_orders.Column<&DrinkOrderRow::DrinkID>();
 
-        ImGui::InputDate("Market Share End", m_DrinkMarketEnd);
+        std::unordered_map<int, int> drink_market_share;
+        for (size_t i = 0; i < drink_orders.Size(); i++) {
+            auto it = orders_in_range.find(ordered_in[i]);
+            if (it != orders_in_range.end())
+                drink_market_share[ordered_drinks[i]] += it->second;
+        }
 
-        if (ImPlot::BeginPlot("Drinks market share", plot_size)) {
-             
-            List<String> names;
-            List<float> values;
-            List<const char *> names_ptr;
+        const auto &drinks = m_Snapshot.Drinks();
+        const auto &ids = drinks.Column<&DrinkRow::ID>();
+        const auto &names = drinks.Column<&DrinkRow::Name>();
 
-            std::map<int, int> drink_market_share;
+        m_DrinkMarketStats = {};
+        for (size_t i = 0; i < drinks.Size(); i++) {
+            auto it = drink_market_share.find(ids[i]);
+            if (it != drink_market_share.end())
+                AddShares(m_DrinkMarketStats, m_Snapshot.Strings().Decode(names[i]), it->second);
+        }
+        NormalizeShares(m_DrinkMarketStats);
+    }
 
-            for (auto query = m_OrdersLogTable.Query(m_DrinkMarketBegin, m_DrinkMarketEnd); query; query.Next()) {
-                int order_id = query.GetColumnInt(0);
+    static void PlotShare(const char *title, const ShareChart &chart, ImVec2 size){
+        if (!ImPlot::BeginPlot(title, size))
+            return;
 
-                for (auto order_drink = m_DrinkOrdersTable.Query(order_id); order_drink; order_drink.Next()) {
-                    int drink_id = order_drink.GetColumnInt(1);
+        ImPlot::PlotPieChart(chart.Names.Data(), chart.Values.Data(), chart.Values.Size(),
+                             0, 0, 1, "%.1f%%");
 
-                    drink_market_share[drink_id] += 1;
-                }
-            }
+        ImPlot::EndPlot();
+    }
+   
+public:
+    AnalyticsWindow(BrewerySnapshot &snapshot): 
+        m_Snapshot(snapshot)
+    {}
 
-            for (auto [drink_id, bought] : drink_market_share) {
-                auto query = m_DrinksTable.Query(drink_id);
-                auto drink_name = query.GetColumnString(1);
-                names.Add(drink_name);
-                names_ptr.Add(names.Last().Data());
-                values.Add(bought);
-            }
+    void Draw() {
+        ImGui::Begin("Stats");
 
-            float sum = 0;
-            
-            for (auto value : values) 
-                sum += value; 
+        const auto win_size = ImGui::GetContentRegionAvail();
+        const auto plot_size = ImVec2{win_size.x * 0.6f, win_size.y * 0.6f};
 
-            for (float &value : values) value = (value / sum) * 100;
+        if(m_SnapshotVersion != m_Snapshot.Version()){
+            m_SnapshotVersion = m_Snapshot.Version();
+            m_IsWaitersStatsStale = true;
+            m_IsDrinkMarketStatsStale = true;
+        }
+
+        if(InputDateRange("Waiters Start", m_WaitersBegin, "Waiters End", m_WaitersEnd))
+            m_IsWaitersStatsStale = true;
 
+        if(m_IsWaitersStatsStale && m_Snapshot.IsLoaded())
+            ComputeWaitersStats();
+        m_IsWaitersStatsStale = false;
+
+        ImGui::Text("Orders: %d Checkout: %.2f Tips: %.2f", m_WaitersTotals.Orders, m_WaitersTotals.Checkout, m_WaitersTotals.Tips);
+        
+        PlotShare("Waiters stats", m_WaitersStats, plot_size);
 
-            ImPlot::PlotPieChart(names_ptr.Data(), values.Data(), values.Size(),
-                                 0, 0, 1, "%.1f%%");
+        if(InputDateRange("Market Share Start", m_DrinkMarketBegin, "Market Share End", m_DrinkMarketEnd))
+            m_IsDrinkMarketStatsStale = true;
 
-            ImPlot::EndPlot();
-        }        
+        if(m_IsDrinkMarketStatsStale && m_Snapshot.IsLoaded())
+            ComputeDrinkMarketStats();
+        m_IsDrinkMarketStatsStale = false;
+
+        PlotShare("Drinks market share", m_DrinkMarketStats, plot_size);
 
         ImGui::End();
     }
@@ -1400,29 +1598,76 @@ private:
     Database &m_Database;
     List<std::string> m_History;
     size_t m_HistoryIndex = 0;
+
+    std::unique_ptr<BulkImport> m_Import;
+    std::chrono::steady_clock::time_point m_ImportStart;
+    std::chrono::steady_clock::time_point m_ImportReport;
+
+    std::unique_ptr<OnlineBackup> m_Backup;
+    std::chrono::steady_clock::time_point m_BackupStart;
+    std::chrono::steady_clock::time_point m_BackupReport;
+
+    // Rows of the last statement, its cursor keeps a read snapshot open on
+    // the session until they are all scrolled through or the next statement runs
+    ConsoleSession m_Session;
+    std::optional<PagedResult> m_Result;
 public:
+    static constexpr auto ReportPeriod = std::chrono::seconds(1);
+    static constexpr float ResultHeightShare = 0.6f;
+    static constexpr int MaxResultColumns = 64;
+    static constexpr const char *DefaultBackupPath = "brewery_backup.sqlite";
+
     ConsoleWindow(DatabaseLogger &logger, Database &db):
             m_Logger(logger),
             m_Database(db),
-            m_History{""}
+            m_History{""},
+            m_Session(db.FilePath())
     {
 
         Register("clear", {this, &ConsoleWindow::OnClear});
+        Register("cache", {this, &ConsoleWindow::OnCache});
+        Register("slow", {this, &ConsoleWindow::OnSlow});
+        Register("import", {this, &ConsoleWindow::OnImport});
+        Register("backup", {this, &ConsoleWindow::OnBackup});
+        Register("budget", {this, &ConsoleWindow::OnBudget});
+        Register("bench", {this, &ConsoleWindow::OnBench});
     }
 
     void Draw(){
+        UpdateImport();
+        UpdateBackup();
+        UpdateSession();
 
-        const auto &lines = m_Logger.Lines();
+        m_Logger.Pump();
         ImGui::Begin("Console");
 
-        const float footer_height_to_reserve = ImGui::GetStyle().ItemSpacing.y + ImGui::GetFrameHeightWithSpacing();
-        ImGui::BeginChild("##Text", ImVec2(0, -footer_height_to_reserve));
-
-        for(const auto &line: lines)
-            ImGui::TextWrapped("%s", line.Data());
+        const bool is_busy = m_Session.IsBusy();
+        const float footer_height_to_reserve = ImGui::GetStyle().ItemSpacing.y + ImGui::GetFrameHeightWithSpacing() * (1 + is_busy);
+        const float result_height = m_Result ? (ImGui::GetContentRegionAvail().y - footer_height_to_reserve) * ResultHeightShare : 0;
+        ImGui::BeginChild("##Text", ImVec2(0, -footer_height_to_reserve - result_height), false, ImGuiWindowFlags_HorizontalScrollbar);
+
+        // Lines are unwrapped and cut at their first line break so they share one height, only the visible ones are submitted
+        ImGuiListClipper clipper;
+        clipper.Begin((int)m_Logger.Size());
+        while(clipper.Step()){
+            for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+                ImGui::TextFirstLine(m_Logger[i]);
+        }
+        clipper.End();
 
         ImGui::EndChild();
 
+        if(m_Result)
+            DrawResult(result_height - ImGui::GetStyle().ItemSpacing.y);
+
+        if(is_busy){
+            const double seconds = std::chrono::duration<double>(m_Session.RunningFor()).count();
+            ImGui::Text("Running for %.1f s, %llu instructions", seconds, (unsigned long long)m_Session.Progress());
+            ImGui::SameLine();
+            if(ImGui::Button("Cancel") || (ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Escape))))
+                m_Session.Cancel();
+        }
+
         ImGui::Separator();
 
         ImGui::PushItemWidth(ImGui::GetWindowWidth());
@@ -1431,9 +1676,10 @@ public:
             m_Logger.Log("[User]: %", m_CurrentLine.Data());
 
             if(!TryInterpret(m_CurrentLine.Data())) {
-                auto query = m_Database.Query(m_CurrentLine.Data());
-                if(query)
-                    m_Logger.Log(query);
+                if(m_Session.Run(m_CurrentLine.Data()))
+                    m_Result.reset();
+                else
+                    m_Logger.Log("[Session]: the last statement is still running, cancel it with Escape");
             }
 
             m_CurrentLine.Clear();
@@ -1446,7 +1692,397 @@ public:
         ImGui::End();
     }
 
+    // Only the visible rows are submitted, the next page is fetched once they get close to the last fetched one
+    void DrawResult(float height){
+        PagedResult &result = *m_Result;
+        ImGui::Text("[QueryResult]: %zu%s rows", result.RowCount(), result.IsComplete() ? "" : "+");
+
+        const int column_count = (int)std::min<size_t>(result.GetColumnCount(), MaxResultColumns);
+        const ImGuiTableFlags flags = ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
+        if(!column_count || !ImGui::BeginTable("##Result", column_count, flags, ImVec2(0, height - ImGui::GetTextLineHeightWithSpacing())))
+            return;
+
+        ImGui::TableSetupScrollFreeze(0, 1);
+        for(int i = 0; i < column_count; i++)
+            ImGui::TableSetupColumn(result.GetColumnName(i));
+        ImGui::TableHeadersRow();
+
+        // A trailing row stands for the rows not fetched yet, so the scrollbar reaches past the fetched ones
+        const size_t row_count = result.RowCount();
+        size_t display_end = 0;
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int)row_count + !result.IsComplete());
+        while(clipper.Step()){
+            for(int row_index = clipper.DisplayStart; row_index < clipper.DisplayEnd; row_index++){
+                ImGui::TableNextRow();
+                if(row_index == (int)row_count){
+                    ImGui::TableNextColumn();
+                    ImGui::TextDisabled("...");
+                    continue;
+                }
+
+                const auto row = result.RowAt(row_index);
+                for(int i = 0; i < column_count; i++){
+                    ImGui::TableNextColumn();
+                    if(const char *text = row.GetColumnString(i))
+                        ImGui::TextFirstLine(text);
+                    else
+                        ImGui::TextDisabled("NULL");
+                }
+            }
+            display_end = std::max(display_end, (size_t)clipper.DisplayEnd);
+        }
+        clipper.End();
+
+        ImGui::EndTable();
+
+        // A page at a time, the session refuses while one is on its way
+        if(!result.IsComplete() && display_end + ConsoleSession::PageSize / 2 >= row_count)
+            m_Session.FetchPage();
+    }
+
+    // bench <iterations> [warmup <count>] <sql>
+    void OnBench(const char *args){
+        unsigned long long iterations = 0;
+        unsigned long long warmup = ConsoleSession::DefaultBenchWarmup;
+        int offset = 0;
+        if(sscanf(args, "bench %llu %n", &iterations, &offset) != 1 || !iterations || !offset){
+            m_Logger.Log("[Bench]: usage: bench <iterations> [warmup <count>] <sql>");
+            return;
+        }
+
+        const char *sql = args + offset;
+        int warmup_offset = 0;
+        if(sscanf(sql, "warmup %llu %n", &warmup, &warmup_offset) == 1 && warmup_offset)
+            sql += warmup_offset;
+
+        if(!*sql){
+            m_Logger.Log("[Bench]: usage: bench <iterations> [warmup <count>] <sql>");
+            return;
+        }
+
+        if(m_Session.Bench(sql, iterations, warmup))
+            m_Result.reset();
+        else
+            m_Logger.Log("[Session]: the last statement is still running, cancel it with Escape");
+    }
+
+    // budget [seconds], zero lets statements run for as long as they take
+    void OnBudget(const char *args){
+        float seconds = 0;
+        if(sscanf(args, "budget %f", &seconds) == 1)
+            m_Session.SetTimeBudget(std::chrono::duration_cast<ConsoleSession::Clock::duration>(std::chrono::duration<float>(seconds)));
+
+        const auto budget = std::chrono::duration_cast<std::chrono::milliseconds>(m_Session.TimeBudget());
+        if(budget.count())
+            m_Logger.Log("[Session]: statements may run for % ms", budget.count());
+        else
+            m_Logger.Log("[Session]: statements may run for as long as they take");
+    }
+
     void OnClear(const char *){
+        if(m_Session.IsBusy())
+            m_Session.Cancel();
+        else
+            m_Session.Close();
+        m_Result.reset();
         m_Logger.Clear();
     }
-};
\ No newline at end of file
+
+    void OnCache(const char *args){
+        const auto &stats = m_Database.CacheStats();
+        m_Logger.Log("[Cache]: % hits, % misses, % evictions", stats.Hits, stats.Misses, stats.Evictions);
+
+        if(strstr(args, "reset"))
+            m_Database.ResetCacheStats();
+    }
+
+    // slow [clear | threshold <ms>]
+    void OnSlow(const char *args){
+        SlowQueryLog &slow_log = m_Database.Profiler().SlowLog();
+
+        float threshold_ms = 0;
+        const char *threshold = strstr(args, "threshold");
+        if(threshold && sscanf(threshold, "threshold %f", &threshold_ms) == 1){
+            slow_log.SetThreshold(threshold_ms * 1000000);
+            m_Logger.Log("[Slow]: threshold is % us", slow_log.Threshold() / 1000);
+            return;
+        }
+
+        if(strstr(args, "clear")){
+            slow_log.Clear();
+            return;
+        }
+
+        for(const auto &entry: slow_log.Entries()){
+            m_Logger.Log("[Slow]: % us, % rows: %", entry.DurationNs / 1000, entry.Rows, entry.Sql.c_str());
+
+            std::stringstream plan(entry.Plan);
+            for(std::string line; std::getline(plan, line);)
+                m_Logger.Log("    %", line.c_str());
+        }
+    }
+
+    // import <table> <file> | import cancel
+    void OnImport(const char *args){
+        if(strstr(args, "import cancel")){
+            if(m_Import)
+                m_Import->Cancel();
+            return;
+        }
+
+        if(m_Import && m_Import->IsRunning()){
+            m_Logger.Log("[Import]: % is still being imported", m_Import->Table().c_str());
+            return;
+        }
+
+        char table[64] = {};
+        char filepath[512] = {};
+        if(sscanf(args, "import %63s %511[^\n]", table, filepath) != 2){
+            m_Logger.Log("[Import]: usage: import <table> <file.csv | file.bin>");
+            return;
+        }
+
+        m_Import = std::make_unique<BulkImport>(m_Database.FilePath(), table, filepath);
+        m_ImportStart = m_ImportReport = std::chrono::steady_clock::now();
+    }
+
+    // backup [file] | backup cancel
+    void OnBackup(const char *args){
+        if(strstr(args, "backup cancel")){
+            if(m_Backup)
+                m_Backup->Cancel();
+            return;
+        }
+
+        if(m_Backup && m_Backup->IsRunning()){
+            m_Logger.Log("[Backup]: % is still being written", m_Backup->FilePath().c_str());
+            return;
+        }
+
+        char filepath[512] = {};
+        if(sscanf(args, "backup %511[^\n]", filepath) != 1)
+            strcpy(filepath, DefaultBackupPath);
+
+        m_Backup = std::make_unique<OnlineBackup>(m_Database.FilePath(), filepath);
+        m_BackupStart = m_BackupReport = std::chrono::steady_clock::now();
+    }
+private:
+    void UpdateSession(){
+        std::optional<ConsoleSession::Outcome> outcome = m_Session.Poll();
+        if(!outcome)
+            return;
+
+        const double ms = std::chrono::duration<double, std::milli>(outcome->Elapsed).count();
+        if(outcome->Error.size())
+            m_Logger.Log("[Session]: % after % ms", outcome->Error.c_str(), ms);
+
+        if(!outcome->IsFirstPage){
+            if(m_Result)
+                m_Result->Append(Move(outcome->Page), outcome->IsComplete);
+            return;
+        }
+
+        if(outcome->Page.GetColumnCount())
+            m_Result.emplace(Move(outcome->Page), outcome->IsComplete);
+        else if(outcome->Error.empty())
+            m_Logger.Log("[Session]: % rows changed in % ms", outcome->Changes, ms);
+    }
+
+    void UpdateImport(){
+        if(!m_Import)
+            return;
+
+        const auto now = std::chrono::steady_clock::now();
+        const BulkImport::State state = m_Import->GetState();
+        if(state == BulkImport::State::Running && now - m_ImportReport < ReportPeriod)
+            return;
+        m_ImportReport = now;
+
+        const BulkImport::Progress progress = m_Import->GetProgress();
+        const double seconds = std::chrono::duration<double>(now - m_ImportStart).count();
+        const uint64_t rows_per_second = seconds > 0 ? progress.Rows / seconds : 0;
+
+        if(state == BulkImport::State::Running){
+            const float MiB = 1024 * 1024;
+            m_Logger.Log("[Import]: %: % rows, % of % MiB, % rows/s", m_Import->Table().c_str(), progress.Rows, progress.Bytes / MiB, progress.TotalBytes / MiB, rows_per_second);
+            return;
+        }
+
+        DatabaseLogger &import_log = m_Import->Log();
+        import_log.Pump();
+        for(size_t i = 0; i < import_log.Size(); i++)
+            m_Logger.Write(import_log[i]);
+
+        if(state == BulkImport::State::Done)
+            m_Logger.Log("[Import]: % rows into % in % s, % rows/s", progress.Rows, m_Import->Table().c_str(), (float)seconds, rows_per_second);
+        else
+            m_Logger.Log("[Import]: % was % after % rows, those stay in the table", m_Import->Table().c_str(), state == BulkImport::State::Cancelled ? "cancelled" : "not imported", progress.CommittedRows);
+
+        m_Import.reset();
+    }
+
+    void UpdateBackup(){
+        if(!m_Backup)
+            return;
+
+        const auto now = std::chrono::steady_clock::now();
+        const OnlineBackup::State state = m_Backup->GetState();
+        if(state == OnlineBackup::State::Running && now - m_BackupReport < ReportPeriod)
+            return;
+        m_BackupReport = now;
+
+        const OnlineBackup::Progress progress = m_Backup->GetProgress();
+        if(state == OnlineBackup::State::Running){
+            m_Logger.Log("[Backup]: % of % pages", progress.CopiedPages, progress.TotalPages);
+            return;
+        }
+
+        DatabaseLogger &backup_log = m_Backup->Log();
+        backup_log.Pump();
+        for(size_t i = 0; i < backup_log.Size(); i++)
+            m_Logger.Write(backup_log[i]);
+
+        const float seconds = std::chrono::duration<float>(now - m_BackupStart).count();
+        if(state == OnlineBackup::State::Done)
+            m_Logger.Log("[Backup]: % pages written to '%' in % s", progress.TotalPages, m_Backup->FilePath().c_str(), seconds);
+        else
+            m_Logger.Log("[Backup]: '%' was %", m_Backup->FilePath().c_str(), state == OnlineBackup::State::Cancelled ? "cancelled" : "not written");
+
+        m_Backup.reset();
+    }
+};
+class ProfilerWindow{
+private:
+    enum Column{
+        StatementColumn,
+        CallsColumn,
+        TotalColumn,
+        MeanColumn,
+        P99Column,
+        RowsColumn,
+        FullScanStepsColumn,
+        SortsColumn,
+        VMStepsColumn,
+        ColumnsCount
+    };
+
+    struct Entry{
+        const QueryProfiler::Record *Record;
+        int64_t P99Ns;
+    };
+
+    QueryProfiler &m_Profiler;
+    std::vector<Entry> m_Entries;
+private:
+    static double SortKey(const Entry &entry, int column){
+        const QueryProfiler::Record &record = *entry.Record;
+        switch(column){
+        case CallsColumn:           return record.Calls;
+        case TotalColumn:           return record.TotalNs;
+        case MeanColumn:            return record.MeanNs();
+        case P99Column:             return entry.P99Ns;
+        case RowsColumn:            return record.Rows;
+        case FullScanStepsColumn:   return record.FullScanSteps;
+        case SortsColumn:           return record.Sorts;
+        case VMStepsColumn:         return record.VMSteps;
+        }
+        return 0;
+    }
+
+    void Sort(const ImGuiTableSortSpecs *specs){
+        if(!specs || !specs->SpecsCount)
+            return;
+
+        const int column = specs->Specs[0].ColumnIndex;
+        const bool is_ascending = specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+
+        std::sort(m_Entries.begin(), m_Entries.end(), [&](const Entry &left, const Entry &right){
+            if(column == StatementColumn){
+                const int order = left.Record->Sql.compare(right.Record->Sql);
+                return is_ascending ? order < 0 : order > 0;
+            }
+            const double l = SortKey(left, column);
+            const double r = SortKey(right, column);
+            return is_ascending ? l < r : l > r;
+        });
+    }
+
+    static void TextMicroseconds(int64_t ns){
+        ImGui::Text("%.1f", ns / 1000.0);
+    }
+public:
+    ProfilerWindow(Database &db):
+        m_Profiler(db.Profiler())
+    {}
+
+    void Draw(){
+        ImGui::Begin("Profiler");
+
+        bool is_enabled = m_Profiler.IsEnabled();
+        if(ImGui::Checkbox("Enabled", &is_enabled))
+            m_Profiler.SetEnabled(is_enabled);
+
+        ImGui::SameLine();
+
+        if(ImGui::Button("Reset"))
+            m_Profiler.Reset();
+
+        m_Entries.clear();
+        for(const auto &record: m_Profiler.Records())
+            m_Entries.push_back({&record, record.P99Ns()});
+
+        ImGuiTableFlags flags = 0;
+        flags |= ImGuiTableFlags_Sortable;
+        flags |= ImGuiTableFlags_Resizable;
+        flags |= ImGuiTableFlags_RowBg;
+        flags |= ImGuiTableFlags_ScrollY;
+        flags |= ImGuiTableFlags_BordersInnerV;
+
+        if(ImGui::BeginTable("##Statements", ColumnsCount, flags)){
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Statement", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableSetupColumn("Total ms", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableSetupColumn("Mean us", ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableSetupColumn("P99 us", ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableSetupColumn("Rows", ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableSetupColumn("Full Scan Steps", ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableSetupColumn("Sorts", ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableSetupColumn("VM Steps", ImGuiTableColumnFlags_PreferSortDescending);
+            ImGui::TableHeadersRow();
+
+            Sort(ImGui::TableGetSortSpecs());
+
+            for(const Entry &entry: m_Entries){
+                const QueryProfiler::Record &record = *entry.Record;
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(record.Sql.c_str());
+                if(ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", record.Sql.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)record.Calls);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", record.TotalNs / 1000000.0);
+                ImGui::TableNextColumn();
+                TextMicroseconds(record.MeanNs());
+                ImGui::TableNextColumn();
+                TextMicroseconds(entry.P99Ns);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)record.Rows);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)record.FullScanSteps);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)record.Sorts);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)record.VMSteps);
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::End();
+    }
+};
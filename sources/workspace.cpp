@@ -0,0 +1,137 @@
+#include "implot.h"
+#include "windows.cpp"
+#include <optional>
+#include <tuple>
+
+// Constructs the panel the first frame its window is visible, until then only
+// an empty window is submitted so a docked tab keeps its place
+template<typename PanelType, typename ...ArgsType>
+class LazyPanel{
+private:
+    const char *const m_Window;
+    std::tuple<ArgsType &...> m_Args;
+    std::optional<PanelType> m_Panel;
+public:
+    LazyPanel(const char *window, ArgsType &...args):
+        m_Window(window),
+        m_Args(args...)
+    {}
+
+    void Draw(){
+        if(!m_Panel){
+            const bool is_visible = ImGui::Begin(m_Window);
+            ImGui::End();
+            if(!is_visible)
+                return;
+
+            std::apply([this](ArgsType &...args){ m_Panel.emplace(args...); }, m_Args);
+        }
+        m_Panel->Draw();
+    }
+
+    // Null until the panel was first shown
+    PanelType *Get(){
+        return m_Panel ? &*m_Panel : nullptr;
+    }
+};
+
+// The snapshot only serves the charts, it starts loading when they are first shown
+class AnalyticsPanel{
+private:
+    BrewerySnapshot m_Snapshot;
+    AnalyticsWindow m_Window{m_Snapshot};
+public:
+    AnalyticsPanel(Database &db, QueryExecutor &executor):
+        m_Snapshot(db, executor)
+    {}
+
+    void Draw(){
+        m_Snapshot.Update();
+        m_Window.Draw();
+    }
+
+    bool IsLoaded()const{
+        return m_Snapshot.IsLoaded();
+    }
+};
+
+// The database, the background workers and every panel of the application,
+// with nothing tied to a window or a GPU, so a headless harness can drive the
+// same frames the application does
+class Workspace{
+private:
+    DatabaseLogger m_Logger;
+    Database m_DB;
+    SchemaMigrator m_Schema{m_DB, m_Logger};
+    GroupCommitQueue m_Writes{m_DB};
+
+    WalCheckpointer m_Checkpointer;
+    QueryExecutor m_Executor;
+
+    DrinksTransferProgressWindow m_DrinksTransfer;
+
+    LazyPanel<ConsoleWindow, DatabaseLogger, Database> m_ConsoleWindow{"Console", m_Logger, m_DB};
+    LazyPanel<ProfilerWindow, Database> m_Profiler{"Profiler", m_DB};
+    LazyPanel<DrinksListPanel, Database> m_DrinksList{"Drinks", m_DB};
+    LazyPanel<OrdersLogPanel, Database, GroupCommitQueue> m_OrdersLog{"Orders Log", m_DB, m_Writes};
+    LazyPanel<WaitersListPanel, Database> m_WaitersList{"Waiters", m_DB};
+    LazyPanel<SourcesListPanel, Database, DrinksTransferProgressWindow> m_SourcesList{"Sources", m_DB, m_DrinksTransfer};
+    LazyPanel<GobletsListPanel, Database> m_GobletsList{"Goblets", m_DB};
+    LazyPanel<AnalyticsPanel, Database, QueryExecutor> m_Analytics{"Stats", m_DB, m_Executor};
+public:
+    Workspace(const char *filepath):
+        m_DB(filepath, m_Logger),
+        m_Checkpointer(m_DB, m_Logger),
+        m_Executor(filepath)
+    {}
+
+    Workspace(const Workspace &) = delete;
+
+    Workspace &operator=(const Workspace &) = delete;
+
+    ~Workspace(){
+        // Pending writes capture the panels, commit them while those are alive
+        m_Writes.Flush();
+    }
+
+    void Draw(){
+        ForEachPanel([](const char *, auto &panel){
+            panel.Draw();
+        });
+    }
+
+    // After the panels, commits what they queued
+    void EndFrame(){
+        m_Logger.Pump();
+        m_Writes.Pump();
+        m_DB.SyncExternalChanges();
+    }
+
+    // Calls 'function(name, panel)' for every panel, in drawing order
+    template<typename FunctionType>
+    void ForEachPanel(FunctionType function){
+        function("Console", m_ConsoleWindow);
+        function("Profiler", m_Profiler);
+        function("Drinks", m_DrinksList);
+        function("Orders Log", m_OrdersLog);
+        function("Waiters", m_WaitersList);
+        function("Sources", m_SourcesList);
+        function("Goblets", m_GobletsList);
+        function("Analytics", m_Analytics);
+        function("Drinks Transfer", m_DrinksTransfer);
+    }
+
+    // False until the background loads of the panels shown so far are done
+    bool IsLoaded(){
+        AnalyticsPanel *analytics = m_Analytics.Get();
+        return !analytics || analytics->IsLoaded();
+    }
+
+    Database &GetDatabase(){
+        return m_DB;
+    }
+
+    DatabaseLogger &GetLogger(){
+        return m_Logger;
+    }
+};